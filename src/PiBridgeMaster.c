@@ -43,6 +43,30 @@ void PiBridgeMaster_Stop(void)
 		revpi_gate_fini();
 	piCore_g.eBridgeState = piBridgeStop;
 	clear_bit(PICONTROL_DEV_FLAG_RUNNING, &piDev_g.flags);
+	RevPiDevice_invalidateTopology();
+	rt_mutex_unlock(&piCore_g.lockBridgeState);
+}
+
+/*
+ * Stop the data exchange for a reset. If all modules found by the last
+ * detection are still exchanging data, they are left in the IO protocol and
+ * the following PiBridgeMaster_Reset() only sends the new configuration to
+ * them instead of running the detection again.
+ */
+void PiBridgeMaster_Pause(void)
+{
+	my_rt_mutex_lock(&piCore_g.lockBridgeState);
+	if (piDev_g.revpi_gate_supported)
+		revpi_gate_fini();
+	piCore_g.eBridgeState = piBridgeStop;
+	clear_bit(PICONTROL_DEV_FLAG_RUNNING, &piDev_g.flags);
+	if (eRunStatus_s == enPiBridgeMasterStatus_EndOfConfig &&
+	    piCore_g.data_exchange_running && RevPiDevice_checkTopology()) {
+		/* keep the stop branch of PiBridgeMaster_Run() from leaving the IO protocol */
+		eRunStatus_s = enPiBridgeMasterStatus_Reconfigure;
+	} else {
+		RevPiDevice_invalidateTopology();
+	}
 	rt_mutex_unlock(&piCore_g.lockBridgeState);
 }
 
@@ -64,18 +88,27 @@ void PiBridgeMaster_Reset(void)
 	my_rt_mutex_lock(&piCore_g.lockBridgeState);
 	piCore_g.eBridgeState = piBridgeInit;
 	clear_bit(PICONTROL_DEV_FLAG_RUNNING, &piDev_g.flags);
-	eRunStatus_s = enPiBridgeMasterStatus_Init;
 	bEntering_s = true;
 	RevPiDevice_setStatus(0xff, 0);
 	init_retry = MAX_INIT_RETRIES;
 
-	RevPiDevice_init();
+	/* after PiBridgeMaster_Pause() the detection may be skipped */
+	if (eRunStatus_s != enPiBridgeMasterStatus_Reconfigure ||
+	    !RevPiDevice_restoreTopology()) {
+		eRunStatus_s = enPiBridgeMasterStatus_Init;
+		RevPiDevice_init();
+	}
 	rt_mutex_unlock(&piCore_g.lockBridgeState);
 }
 
-static void PiBridgeMaster_Configure(void)
+/*
+ * Send the configuration to the IO modules. Returns the number of modules
+ * which failed for other reasons than a missing configuration.
+ */
+static int PiBridgeMaster_Configure(void)
 {
 	SDevice *sdev;
+	int failed = 0;
 	int ret;
 	int i;
 
@@ -103,6 +136,7 @@ static void PiBridgeMaster_Configure(void)
 				} else {
 					pr_err("piDIOComm_Init(%d) failed, error %d\n",
 						sdev->i8uAddress, ret);
+					failed++;
 				}
 				sdev->i8uActive = 0;
 			}
@@ -120,6 +154,7 @@ static void PiBridgeMaster_Configure(void)
 				} else {
 					pr_err("piAIOComm_Init(%d) failed, error %d\n",
 						sdev->i8uAddress, ret);
+					failed++;
 				}
 				sdev->i8uActive = 0;
 			}
@@ -131,6 +166,8 @@ static void PiBridgeMaster_Configure(void)
 				pr_err("mio init failed in status-Continue(ret:%d)\n",
 					ret);
 				sdev->i8uActive = 0;
+				if (ret != -ENODATA)
+					failed++;
 			}
 			break;
 		case KUNBUS_FW_DESCR_TYP_PI_RO:
@@ -146,12 +183,14 @@ static void PiBridgeMaster_Configure(void)
 				} else {
 					pr_err("revpi_ro_init(%d) failed, error %d\n",
 						sdev->i8uAddress, ret);
+					failed++;
 				}
 				sdev->i8uActive = 0;
 			}
 			break;
 		}
 	}
+	return failed;
 }
 
 int PiBridgeMaster_Adjust(void)
@@ -211,6 +250,7 @@ int PiBridgeMaster_Adjust(void)
 				RevPiDevice_getDev(j)->i16uOutputOffset = piDev_g.devs->dev[i].i16uOutputOffset;
 				RevPiDevice_getDev(j)->i16uConfigOffset = piDev_g.devs->dev[i].i16uConfigOffset;
 				RevPiDevice_getDev(j)->i16uConfigLength = piDev_g.devs->dev[i].i16uConfigLength;
+				RevPiDevice_getDev(j)->i8uCycleDivider = piDev_g.devs->dev[i].i8uCycleDivider;
 				if (j == 0) {
 					RevPiDevice_setCoreOffset(RevPiDevice_getDev(0)->i16uInputOffset);
 				}
@@ -250,6 +290,7 @@ int PiBridgeMaster_Adjust(void)
 			RevPiDevice_getDev(j)->i16uOutputOffset = piDev_g.devs->dev[i].i16uOutputOffset;
 			RevPiDevice_getDev(j)->i16uConfigOffset = piDev_g.devs->dev[i].i16uConfigOffset;
 			RevPiDevice_getDev(j)->i16uConfigLength = piDev_g.devs->dev[i].i16uConfigLength;
+			RevPiDevice_getDev(j)->i8uCycleDivider = piDev_g.devs->dev[i].i8uCycleDivider;
 			RevPiDevice_getDev(j)->sId.i32uSerialnumber = piDev_g.devs->dev[i].i32uSerialnumber;
 			RevPiDevice_getDev(j)->sId.i16uHW_Revision = piDev_g.devs->dev[i].i16uHW_Revision;
 			RevPiDevice_getDev(j)->sId.i16uSW_Major = piDev_g.devs->dev[i].i16uSW_Major;
@@ -263,6 +304,8 @@ int PiBridgeMaster_Adjust(void)
 	}
 
 	kfree(state);
+	RevPiDevice_scheduleCycles();
+	RevPiDevice_debugfs_update();
 	return result;
 }
 
@@ -313,6 +356,18 @@ void PiBridgeMaster_setDefaults(void)
 	}
 }
 
+/* Set the process image to the default values of the configuration */
+static void PiBridgeMaster_loadDefaults(void)
+{
+	PiBridgeMaster_setDefaults();
+
+	my_rt_mutex_lock(&piDev_g.lockPI);
+	picontrol_image_write_begin();
+	memcpy(piDev_g.ai8uPI, piDev_g.ai8uPIDefault, KB_PI_LEN);
+	picontrol_image_write_end();
+	rt_mutex_unlock(&piDev_g.lockPI);
+}
+
 static void handle_pibridge_ethernet(void)
 {
 	piDev_g.pibridge_mode_ethernet_left = false;
@@ -573,6 +628,35 @@ int PiBridgeMaster_Run(void)
 			bEntering_s = false;
 			break;
 
+		case enPiBridgeMasterStatus_Reconfigure:
+			/*
+			 * The modules of the last detection are still in data
+			 * exchange (see PiBridgeMaster_Pause()), only the new
+			 * configuration has to be sent to them.
+			 */
+			PiBridgeMaster_Adjust();
+			PiBridgeMaster_loadDefaults();
+
+			if (PiBridgeMaster_Configure()) {
+				pr_info("module topology changed -> detect modules\n");
+				/* leave the IO protocol like the stop branch does */
+				ret = piIoComm_gotoGateProtocol();
+				pr_info("piIoComm_gotoGateProtocol returned %d\n", ret);
+				piCore_g.data_exchange_running = false;
+				RevPiDevice_invalidateTopology();
+				RevPiDevice_init();
+				eRunStatus_s = enPiBridgeMasterStatus_Init;
+				bEntering_s = true;
+				break;
+			}
+			pr_info("module topology unchanged, detection skipped\n");
+
+			ret = 0;
+
+			eRunStatus_s = enPiBridgeMasterStatus_EndOfConfig;
+			bEntering_s = false;
+			break;
+
 		case enPiBridgeMasterStatus_EndOfConfig:
 			if (bEntering_s) {
 #ifdef DEBUG_MASTER_STATE
@@ -602,6 +686,7 @@ int PiBridgeMaster_Run(void)
 
 				piIoComm_writeSniff1A(enGpioValue_Low, enGpioMode_Input);
 
+				RevPiDevice_saveTopology();
 				PiBridgeMaster_Adjust();
 
 #ifdef DEBUG_MASTER_STATE
@@ -623,11 +708,7 @@ int PiBridgeMaster_Run(void)
 				}
 				pr_info_master("\n");
 #endif
-				PiBridgeMaster_setDefaults();
-
-				my_rt_mutex_lock(&piDev_g.lockPI);
-				memcpy(piDev_g.ai8uPI, piDev_g.ai8uPIDefault, KB_PI_LEN);
-				rt_mutex_unlock(&piDev_g.lockPI);
+				PiBridgeMaster_loadDefaults();
 
 				/* Set base termination if possible. */
 				if (RevPiDevice_setBaseTermination()) {
@@ -675,6 +756,7 @@ int PiBridgeMaster_Run(void)
 						revpi_gate_fini();
 					piCore_g.eBridgeState = piBridgeStop;
 					clear_bit(PICONTROL_DEV_FLAG_RUNNING, &piDev_g.flags);
+					RevPiDevice_invalidateTopology();
 				} else if (piCore_g.image.usr.i16uRS485ErrorLimit1 > 0
 					   && piCore_g.image.usr.i16uRS485ErrorLimit1 < RevPiDevice_getErrCnt()) {
 					// bad communication with inputs -> set inputs to default values
@@ -902,7 +984,9 @@ int PiBridgeMaster_Run(void)
 			pI1 = (SRevPiProcessImage *)p1;
 			pI2 = (SRevPiProcessImage *)p2;
 			my_rt_mutex_lock(&piDev_g.lockPI);
+			picontrol_image_write_begin();
 			pI1->drv = pI2->drv;
+			picontrol_image_write_end();
 			// The size of _SRevPiProcessImage.usr was 5 bytes before the field rgb_leds was introduced
 			// with Connect 4 and the size changed to 7 bytes. In order to maintain compatibility with existing deviecs,
 			// only the number of bytes defined in MODGATECOM_IDResp.i16uFBS_OutputLength is copied with memcpy.
@@ -30,6 +30,9 @@ typedef enum _EPiBridgeMasterStatus {
 	enPiBridgeMasterStatus_FWUFlashWrite,	// 17
 	enPiBridgeMasterStatus_FWUReset,	// 18
 
+	// reset without module detection, see PiBridgeMaster_Pause()
+	enPiBridgeMasterStatus_Reconfigure,	// 19
+
 } EPiBridgeMasterStatus;
 
 extern EPiBridgeMasterStatus eRunStatus_s;
@@ -39,6 +42,7 @@ int PiBridgeMaster_Adjust(void);
 void PiBridgeMaster_setDefaults(void);
 int PiBridgeMaster_Run(void);
 void PiBridgeMaster_Stop(void);
+void PiBridgeMaster_Pause(void);
 void PiBridgeMaster_Continue(void);
 s32 PiBridgeMaster_FWUModeEnter(u32 address, u8 i8uScanned);
 s32 PiBridgeMaster_FWUsetSerNum(u32 serNum);
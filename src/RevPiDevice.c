@@ -2,7 +2,10 @@
 // SPDX-FileCopyrightText: 2016-2024 KUNBUS GmbH
 
 #include <linux/pibridge_comm.h>
+#include <linux/debugfs.h>
+#include <linux/log2.h>
 #include <linux/of.h>
+#include <linux/seq_file.h>
 
 #include "RevPiDevice.h"
 #include "piAIOComm.h"
@@ -13,6 +16,18 @@
 #include "picontrol_trace.h"
 
 static SDeviceConfig RevPiDevices_s;
+/* module list of the last full detection, see RevPiDevice_saveTopology() */
+static struct {
+	bool valid;
+	u8 i8uAddressRight;
+	bool gatewayRight;
+	u8 i8uAddressLeft;
+	bool gatewayLeft;
+	u8 i8uDeviceCount;
+	SDevice dev[REV_PI_DEV_CNT_MAX+1];
+} topology_s;
+static struct dentry *debugfs_parent_s;
+static struct dentry *debugfs_modules_s;	// one file per module, see RevPiDevice_debugfs_update()
 
 const MODGATECOM_IDResp RevPiCore_ID_g = {
 	.i32uSerialnumber = REV_PI_DEV_DEFAULT_SERIAL,
@@ -143,6 +158,136 @@ void RevPiDevice_handle_internal_telegrams(void)
 }
 
 
+/*
+ * Send a cyclic telegram to a module and record its round trip time, the
+ * bytes on the wire and the errors in the statistics of the module. Returns
+ * the result of pibridge_req_io().
+ */
+int RevPiDevice_req_io(SDevice *dev, u16 cmd, const void *snd_buf, u8 snd_len,
+		       void *rcv_buf, u8 rcv_len)
+{
+	struct revpi_dev_stats *st = &dev->stats;
+	u32 rtt;
+	ktime_t t0;
+	int ret;
+
+	t0 = ktime_get();
+	ret = pibridge_req_io(piCore_g.pibridge, dev->i8uAddress, cmd,
+			      (void *) snd_buf, snd_len, rcv_buf, rcv_len);
+	rtt = ktime_us_delta(ktime_get(), t0);
+
+	st->rtt_sum += rtt;
+	if (!st->requests || rtt < st->rtt_min)
+		st->rtt_min = rtt;
+	if (rtt > st->rtt_max)
+		st->rtt_max = rtt;
+	st->rtt_hist[min_t(unsigned int, fls(rtt >> 6),
+			   REV_PI_DEV_RTT_BUCKETS - 1)]++;
+	st->requests++;
+	st->bytes_sent += IOPROTOCOL_HEADER_LENGTH + snd_len + 1;
+	if (ret >= 0)
+		st->bytes_received += IOPROTOCOL_HEADER_LENGTH + ret + 1;
+
+	if (ret == rcv_len) {
+		st->fail_streak = 0;
+		return ret;
+	}
+
+	if (ret >= 0)
+		st->short_responses++;
+	else if (ret == -EBADMSG)
+		st->crc_errors++;
+	else if (ret == -ETIMEDOUT)
+		st->timeouts++;
+	else
+		st->other_errors++;
+
+	if (++st->fail_streak > st->max_fail_streak)
+		st->max_fail_streak = st->fail_streak;
+
+	return ret;
+}
+
+static int RevPiDevice_stats_show(struct seq_file *m, void *v)
+{
+	u8 addr = (uintptr_t) m->private;
+	struct revpi_dev_stats st;
+	SDevice *dev = NULL;
+	int i;
+
+	for (i = 0; i < RevPiDevice_getDevCnt(); i++) {
+		if (RevPiDevice_getDev(i)->i8uAddress == addr) {
+			dev = RevPiDevice_getDev(i);
+			break;
+		}
+	}
+	if (!dev)
+		return -ENODEV;
+
+	// a copy, the I/O thread updates the statistics without a lock
+	st = dev->stats;
+
+	seq_printf(m, "module type: %u\n", dev->sId.i16uModulType);
+	seq_printf(m, "requests: %llu\n", st.requests);
+	seq_printf(m, "bytes sent: %llu\n", st.bytes_sent);
+	seq_printf(m, "bytes received: %llu\n", st.bytes_received);
+	seq_printf(m, "rtt min: %u us\n", st.rtt_min);
+	seq_printf(m, "rtt avg: %llu us\n",
+		   st.requests ? div64_u64(st.rtt_sum, st.requests) : 0);
+	seq_printf(m, "rtt max: %u us\n", st.rtt_max);
+	for (i = 0; i < REV_PI_DEV_RTT_BUCKETS; i++) {
+		if (i < REV_PI_DEV_RTT_BUCKETS - 1)
+			seq_printf(m, "rtt < %u us: %u\n", 64 << i,
+				   st.rtt_hist[i]);
+		else
+			seq_printf(m, "rtt >= %u us: %u\n", 64 << (i - 1),
+				   st.rtt_hist[i]);
+	}
+	seq_printf(m, "crc errors: %u\n", st.crc_errors);
+	seq_printf(m, "timeouts: %u\n", st.timeouts);
+	seq_printf(m, "short responses: %u\n", st.short_responses);
+	seq_printf(m, "other errors: %u\n", st.other_errors);
+	seq_printf(m, "failure streak: %u\n", st.fail_streak);
+	seq_printf(m, "max failure streak: %u\n", st.max_fail_streak);
+	seq_printf(m, "recoveries: %u\n", st.recoveries);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(RevPiDevice_stats);
+
+void RevPiDevice_debugfs_init(struct dentry *parent)
+{
+	debugfs_parent_s = parent;
+	debugfs_modules_s = debugfs_create_dir("modules", parent);
+}
+
+/*
+ * Create a file with the statistics of each active module, named by its
+ * address. Called after the modules were detected and adjusted.
+ */
+void RevPiDevice_debugfs_update(void)
+{
+	char name[4];
+	SDevice *dev;
+	int i;
+
+	if (IS_ERR_OR_NULL(debugfs_modules_s))
+		return;
+
+	debugfs_remove_recursive(debugfs_modules_s);
+	debugfs_modules_s = debugfs_create_dir("modules", debugfs_parent_s);
+
+	for (i = 0; i < RevPiDevice_getDevCnt(); i++) {
+		dev = RevPiDevice_getDev(i);
+		if (!dev->i8uActive || dev->i8uAddress == 0)
+			continue;
+		snprintf(name, sizeof(name), "%u", dev->i8uAddress);
+		debugfs_create_file(name, 0444, debugfs_modules_s,
+				    (void *)(uintptr_t) dev->i8uAddress,
+				    &RevPiDevice_stats_fops);
+	}
+}
+
 int RevPiDevice_hat_serial(void)
 {
 	struct device_node *np;
@@ -174,6 +319,8 @@ int RevPiDevice_hat_serial(void)
 
 void RevPiDevice_init(void)
 {
+	int i;
+
 	pr_debug("RevPiDevice_init()\n");
 
 	piCore_g.cycle_num = 0;
@@ -186,6 +333,9 @@ void RevPiDevice_init(void)
 	RevPiDevices_s.gatewayLeft = false;
 	RevPiDevice_resetDevCnt();	// counter for detected devices
 	RevPiDevices_s.i16uErrorCnt = 0;
+	RevPiDevices_s.i32uCycle = 0;
+	for (i = 0; i < ARRAY_SIZE(RevPiDevices_s.dev); i++)
+		memset(&RevPiDevices_s.dev[i].stats, 0, sizeof(struct revpi_dev_stats));
 
 	// RevPi as first entry to device list
 	RevPiDevice_getDev(RevPiDevice_getDevCnt())->i8uAddress = 0;
@@ -247,25 +397,216 @@ void RevPiDevice_init(void)
 	RevPiDevice_incDevCnt();
 }
 
+/*
+ * Remember the modules found by the detection, before PiBridgeMaster_Adjust()
+ * merges the configuration into the list. A reset can restore this list with
+ * RevPiDevice_restoreTopology() instead of detecting the modules again.
+ */
+void RevPiDevice_saveTopology(void)
+{
+	topology_s.i8uAddressRight = RevPiDevices_s.i8uAddressRight;
+	topology_s.gatewayRight = RevPiDevices_s.gatewayRight;
+	topology_s.i8uAddressLeft = RevPiDevices_s.i8uAddressLeft;
+	topology_s.gatewayLeft = RevPiDevices_s.gatewayLeft;
+	topology_s.i8uDeviceCount = RevPiDevices_s.i8uDeviceCount;
+	memcpy(topology_s.dev, RevPiDevices_s.dev, sizeof(topology_s.dev));
+	topology_s.valid = true;
+}
+
+void RevPiDevice_invalidateTopology(void)
+{
+	topology_s.valid = false;
+}
+
+/*
+ * Check if the modules of the last detection are still in data exchange,
+ * i.e. every detected module answered its last cyclic telegram.
+ */
+bool RevPiDevice_checkTopology(void)
+{
+	SDevice *dev;
+	int i;
+
+	if (!topology_s.valid)
+		return false;
+
+	for (i = 0; i < RevPiDevice_getDevCnt(); i++) {
+		dev = RevPiDevice_getDev(i);
+		if (dev->i8uScan && dev->i8uActive && dev->i16uErrorCnt)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Restore the module list of the last detection. Returns false if there
+ * is none, the caller has to run the detection then.
+ */
+bool RevPiDevice_restoreTopology(void)
+{
+	int i;
+
+	if (!topology_s.valid)
+		return false;
+
+	piCore_g.cycle_num = 0;
+	piCore_g.comm_errors = 0;
+	piCore_g.i8uLeftMGateIdx = REV_PI_DEV_UNDEF;
+	piCore_g.i8uRightMGateIdx = REV_PI_DEV_UNDEF;
+	RevPiDevices_s.i8uAddressRight = topology_s.i8uAddressRight;
+	RevPiDevices_s.gatewayRight = topology_s.gatewayRight;
+	RevPiDevices_s.i8uAddressLeft = topology_s.i8uAddressLeft;
+	RevPiDevices_s.gatewayLeft = topology_s.gatewayLeft;
+	RevPiDevices_s.i8uDeviceCount = topology_s.i8uDeviceCount;
+	RevPiDevices_s.i16uErrorCnt = 0;
+	RevPiDevices_s.i32uCycle = 0;
+	memcpy(RevPiDevices_s.dev, topology_s.dev, sizeof(RevPiDevices_s.dev));
+	for (i = 0; i < ARRAY_SIZE(RevPiDevices_s.dev); i++) {
+		RevPiDevices_s.dev[i].i16uErrorCnt = 0;
+		memset(&RevPiDevices_s.dev[i].stats, 0, sizeof(struct revpi_dev_stats));
+	}
+	return true;
+}
+
 void revpi_dev_update_state(u8 i8uDevice, u32 r, int *retval)
 {
+	SDevice *dev = RevPiDevice_getDev(i8uDevice);
+
 	if (r) {
-		if (RevPiDevice_getDev(i8uDevice)->i16uErrorCnt < 255) {
-			RevPiDevice_getDev(i8uDevice)->i16uErrorCnt++;
+		if (dev->i16uErrorCnt < 255) {
+			dev->i16uErrorCnt++;
+		}
+		else if (dev->i8uModuleState != IOSTATE_OFFLINE) {
+			dev->i8uModuleState = IOSTATE_OFFLINE;
+			picontrol_post_event(NULL, KB_EVENT_MODULE_OFFLINE,
+					     dev->i8uAddress);
 		}
-		else
-			RevPiDevice_getDev(i8uDevice)->i8uModuleState = IOSTATE_OFFLINE;
 		*retval -= 1;	// tell calling function that an error occured
-		if (RevPiDevice_getDev(i8uDevice)->i16uErrorCnt > 1) {
+		if (dev->i16uErrorCnt > 1) {
 			// the first error is ignored
-			RevPiDevices_s.i16uErrorCnt += RevPiDevice_getDev(i8uDevice)->i16uErrorCnt;
+			RevPiDevices_s.i16uErrorCnt += dev->i16uErrorCnt;
 		}
 	} else {
-		RevPiDevice_getDev(i8uDevice)->i16uErrorCnt = 0;
-		RevPiDevice_getDev(i8uDevice)->i8uModuleState = IOSTATE_CYCLIC_IO;
+		if (dev->i8uModuleState == IOSTATE_OFFLINE)
+			picontrol_post_event(NULL, KB_EVENT_MODULE_ONLINE,
+					     dev->i8uAddress);
+		dev->i16uErrorCnt = 0;
+		dev->i8uModuleState = IOSTATE_CYCLIC_IO;
+	}
+}
+
+//*************************************************************************************************
+//| Function: RevPiDevice_scheduleCycles
+//|
+//! \brief assign a cycle phase to every module with a cycle divider
+//!
+//! \detailed Dividers are rounded down to a power of 2 and limited to
+//! REV_PI_DEV_MAX_DIVIDER, so the schedule repeats after REV_PI_DEV_MAX_DIVIDER
+//! cycles. Modules are placed greedily, those with the smallest divider first,
+//! into the phase whose busiest cycle has the fewest telegrams. This spreads
+//! slow modules over the cycles and keeps the cycle time flat.
+//!
+//! \ingroup
+//-------------------------------------------------------------------------------------------------
+void RevPiDevice_scheduleCycles(void)
+{
+	u8 load[REV_PI_DEV_MAX_DIVIDER] = { 0 };
+	unsigned int div, phase, best, best_load, peak, c;
+	u8 i8uDevice;
+	SDevice *dev;
+
+	for (i8uDevice = 0; i8uDevice < RevPiDevice_getDevCnt(); i8uDevice++) {
+		dev = RevPiDevice_getDev(i8uDevice);
+
+		dev->i8uCyclePhase = 0;
+		if (dev->i8uCycleDivider > REV_PI_DEV_MAX_DIVIDER)
+			dev->i8uCycleDivider = REV_PI_DEV_MAX_DIVIDER;
+		else if (dev->i8uCycleDivider > 1)
+			dev->i8uCycleDivider = rounddown_pow_of_two(dev->i8uCycleDivider);
+	}
+
+	for (div = 1; div <= REV_PI_DEV_MAX_DIVIDER; div <<= 1) {
+		for (i8uDevice = 0; i8uDevice < RevPiDevice_getDevCnt(); i8uDevice++) {
+			dev = RevPiDevice_getDev(i8uDevice);
+
+			if (!dev->i8uActive || (dev->i8uCycleDivider ?: 1) != div)
+				continue;
+
+			best = 0;
+			best_load = UINT_MAX;
+			for (phase = 0; phase < div; phase++) {
+				peak = 0;
+				for (c = phase; c < REV_PI_DEV_MAX_DIVIDER; c += div)
+					peak = max_t(unsigned int, peak, load[c]);
+				if (peak < best_load) {
+					best_load = peak;
+					best = phase;
+				}
+			}
+
+			dev->i8uCyclePhase = best;
+			for (c = best; c < REV_PI_DEV_MAX_DIVIDER; c += div)
+				load[c]++;
+		}
 	}
 }
 
+static bool RevPiDevice_isDue(SDevice *dev)
+{
+	if (dev->i8uCycleDivider <= 1)
+		return true;
+
+	return (RevPiDevices_s.i32uCycle & (dev->i8uCycleDivider - 1)) == dev->i8uCyclePhase;
+}
+
+/*
+ * Send the configuration to an offline module again, e.g. if it dropped
+ * to its safe state after the communication was lost. Only one module is
+ * recovered per cycle and every module only every REV_PI_DEV_RECOVER_CYCLES
+ * cycles, so the other modules keep their cycle time. Returns true if the
+ * cyclic telegram should be sent to the module in this cycle.
+ */
+static bool RevPiDevice_recover(u8 i8uDevice, bool *slot_used)
+{
+	SDevice *dev = RevPiDevice_getDev(i8uDevice);
+	int ret;
+
+	if (*slot_used ||
+	    RevPiDevices_s.i32uCycle - dev->i32uRecoverCycle < REV_PI_DEV_RECOVER_CYCLES)
+		return false;
+
+	*slot_used = true;
+	dev->i32uRecoverCycle = RevPiDevices_s.i32uCycle;
+
+	switch (dev->sId.i16uModulType) {
+	case KUNBUS_FW_DESCR_TYP_PI_DIO_14:
+	case KUNBUS_FW_DESCR_TYP_PI_DI_16:
+	case KUNBUS_FW_DESCR_TYP_PI_DO_16:
+		ret = piDIOComm_Init(i8uDevice);
+		break;
+	case KUNBUS_FW_DESCR_TYP_PI_AIO:
+		ret = piAIOComm_Init(i8uDevice);
+		break;
+	case KUNBUS_FW_DESCR_TYP_PI_MIO:
+		ret = revpi_mio_init(i8uDevice);
+		break;
+	case KUNBUS_FW_DESCR_TYP_PI_RO:
+		ret = revpi_ro_init(i8uDevice);
+		break;
+	default:
+		return true;
+	}
+
+	if (ret) {
+		pr_debug("recovery of module %d failed (%d)\n", dev->i8uAddress, ret);
+		return false;
+	}
+
+	pr_info("module %d configured again\n", dev->i8uAddress);
+	dev->stats.recoveries++;
+	return true;
+}
+
 //*************************************************************************************************
 //| Function: RevPiDevice_run
 //|
@@ -282,14 +623,24 @@ int RevPiDevice_run(void)
 	u8 i8uDevice = 0;
 	u32 r;
 	int retval = 0;
+	bool recover_slot_used = false;
 	SDevice *dev;
 
 	RevPiDevices_s.i16uErrorCnt = 0;
+	RevPiDevices_s.i32uCycle++;
 
 	for (i8uDevice = 0; i8uDevice < RevPiDevice_getDevCnt(); i8uDevice++) {
 		dev = RevPiDevice_getDev(i8uDevice);
 
-		if (dev->i8uActive) {
+		if (dev->i8uActive && RevPiDevice_isDue(dev)) {
+			if (dev->i8uModuleState == IOSTATE_OFFLINE &&
+			    dev->i16uErrorCnt >= 255 &&
+			    !RevPiDevice_recover(i8uDevice, &recover_slot_used)) {
+				// count it as failed telegram for the error limits and the LED
+				revpi_dev_update_state(i8uDevice, 1, &retval);
+				continue;
+			}
+
 			trace_picontrol_cyclic_device_data_start(dev->i8uAddress);
 
 			switch (dev->sId.i16uModulType) {
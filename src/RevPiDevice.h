@@ -9,12 +9,35 @@
 #include "piIOComm.h"
 
 typedef struct _SRevPiProcessImage SRevPiProcessImage;
+struct dentry;
 
 #define REV_PI_DEV_UNDEF            255
 #define REV_PI_DEV_FIRST_RIGHT      32
 #define REV_PI_DEV_FIRST_LEFT	    (REV_PI_DEV_FIRST_RIGHT - 1)
 #define REV_PI_DEV_CNT_MAX          64
 #define REV_PI_DEV_DEFAULT_SERIAL   1
+#define REV_PI_DEV_MAX_DIVIDER      32	// power of 2
+
+#define REV_PI_DEV_RTT_BUCKETS      8	// < 64us, < 128us, ..., >= 4096us
+#define REV_PI_DEV_RECOVER_CYCLES   50	// cycles between two recovery attempts of an offline module
+
+// statistics of the cyclic telegrams of a module, see RevPiDevice_req_io()
+struct revpi_dev_stats {
+    u64 requests;
+    u64 bytes_sent;		// including header and crc
+    u64 bytes_received;
+    u64 rtt_sum;		// round trip times in usecs
+    u32 rtt_min;
+    u32 rtt_max;
+    u32 rtt_hist[REV_PI_DEV_RTT_BUCKETS];
+    u32 crc_errors;
+    u32 timeouts;
+    u32 short_responses;	// response shorter than expected
+    u32 other_errors;
+    u32 fail_streak;		// consecutive failed requests
+    u32 max_fail_streak;
+    u32 recoveries;		// configuration sent again after the module went offline
+};
 
 typedef struct _SDevice
 {
@@ -29,6 +52,10 @@ typedef struct _SDevice
     MODGATECOM_IDResp sId;
     u8 i8uModuleState;
 	u8 i8uPriv;	//used by the module privately
+    u8 i8uCycleDivider;		// telegram every n-th cycle, 0 or 1: every cycle
+    u8 i8uCyclePhase;		// cycle in which the telegram is sent, see RevPiDevice_scheduleCycles()
+    u32 i32uRecoverCycle;	// cycle of the last recovery attempt, see RevPiDevice_recover()
+    struct revpi_dev_stats stats;
 } SDevice;
 
 
@@ -43,6 +70,7 @@ typedef struct _SDeviceConfig
 
     u8  i8uStatus;               // status bitfield of RevPi
     unsigned int offset;		// Offset in RevPi in process image
+    u32 i32uCycle;		// number of calls of RevPiDevice_run()
     SDevice dev[REV_PI_DEV_CNT_MAX+1];
 } SDeviceConfig;
 
@@ -51,8 +79,13 @@ typedef struct _SDeviceConfig
 bool RevPiDevice_writeNextConfiguration(u8 i8uAddress_p, MODGATECOM_IDResp *pModgateId_p);
 
 void RevPiDevice_init(void);
+void RevPiDevice_saveTopology(void);
+void RevPiDevice_invalidateTopology(void);
+bool RevPiDevice_checkTopology(void);
+bool RevPiDevice_restoreTopology(void);
 
 int RevPiDevice_run(void);
+void RevPiDevice_scheduleCycles(void);
 bool RevPiDevice_writeNextConfigurationRight(void);
 bool RevPiDevice_writeNextConfigurationLeft(void);
 void RevPiDevice_startDataexchange(void);
@@ -76,6 +109,10 @@ unsigned int RevPiDevice_getCoreOffset(void);
 int RevPiDevice_hat_serial(void);
 void revpi_dev_update_state(u8 i8uDevice, u32 r, int *retval);
 void RevPiDevice_handle_internal_telegrams(void);
+int RevPiDevice_req_io(SDevice *dev, u16 cmd, const void *snd_buf, u8 snd_len,
+		       void *rcv_buf, u8 rcv_len);
+void RevPiDevice_debugfs_init(struct dentry *parent);
+void RevPiDevice_debugfs_update(void);
 int RevPiDevice_setBaseTermination(void);
 int RevPiDevice_setLeftModuleTermination(bool terminate);
 int RevPiDevice_setRightModuleTermination(bool terminate);
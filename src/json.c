@@ -244,6 +244,14 @@ static inline void *memory_realloc(void *(*realloc_fct)(void *, size_t), void *p
     return (realloc_fct) ? realloc_fct(ptr, size) : krealloc(ptr, size, GFP_KERNEL);
 }
 
+static inline void memory_free(void (*free_fct)(void *), void *ptr)
+{
+    if (free_fct)
+	free_fct(ptr);
+    else
+	kfree(ptr);
+}
+
 static inline void *memory_calloc(void *(*calloc_fct)(size_t, size_t), size_t nmemb, size_t size)
 {
     return (calloc_fct) ? calloc_fct(nmemb, size) : kcalloc(nmemb, size, GFP_KERNEL);
@@ -251,6 +259,7 @@ static inline void *memory_calloc(void *(*calloc_fct)(size_t, size_t), size_t nm
 
 #define parser_calloc(parser, n, s) memory_calloc(parser->config.user_calloc, n, s)
 #define parser_realloc(parser, n, s) memory_realloc(parser->config.user_realloc, n, s)
+#define parser_free(parser, p) memory_free(parser->config.user_free, p)
 
 static int state_grow(json_parser *parser)
 {
@@ -611,7 +620,7 @@ int json_parser_init(json_parser *parser, json_config *config,
 
     parser->buffer = parser_calloc(parser, parser->buffer_size, sizeof(char));
     if (!parser->buffer) {
-	kfree(parser->stack);
+	parser_free(parser, parser->stack);
 	return JSON_ERROR_NO_MEMORY;
     }
     return 0;
@@ -622,8 +631,8 @@ int json_parser_free(json_parser *parser)
 {
     if (!parser)
 	return 0;
-    kfree(parser->stack);
-    kfree(parser->buffer);
+    parser_free(parser, parser->stack);
+    parser_free(parser, parser->buffer);
     parser->stack = NULL;
     parser->buffer = NULL;
     return 0;
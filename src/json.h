@@ -70,6 +70,7 @@ typedef struct {
     int allow_yaml_comments;
     void * (*user_calloc)(size_t nmemb, size_t size);
     void * (*user_realloc)(void *ptr, size_t size);
+    void (*user_free)(void *ptr);
 } json_config;
 
 typedef struct json_parser {
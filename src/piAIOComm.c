@@ -264,9 +264,13 @@ u32 piAIOComm_sendCyclicTelegram(u8 devnum)
 		memset(snd_buf, 0, AIO_OUTPUT_DATA_LEN);
 	}
 
-	ret = pibridge_req_io(piCore_g.pibridge, addr, IOP_TYP1_CMD_DATA,
-			      snd_buf, AIO_OUTPUT_DATA_LEN, rcv_buf,
-			      AIO_INPUT_DATA_LEN);
+	/*
+	 * The request also polls the inputs and the firmware has no command
+	 * for a partial output block, so both values are sent every cycle.
+	 */
+	ret = RevPiDevice_req_io(revpi_dev, IOP_TYP1_CMD_DATA, snd_buf,
+				 AIO_OUTPUT_DATA_LEN, rcv_buf,
+				 AIO_INPUT_DATA_LEN);
 	if (ret != AIO_INPUT_DATA_LEN) {
 		pr_debug("AIO addr %2d: communication failed (req:%zu,ret:%d)\n",
 			addr, AIO_INPUT_DATA_LEN, ret);
@@ -279,8 +283,10 @@ u32 piAIOComm_sendCyclicTelegram(u8 devnum)
 
 	if (!test_bit(PICONTROL_DEV_FLAG_STOP_IO, &piDev_g.flags)) {
 		my_rt_mutex_lock(&piDev_g.lockPI);
+		picontrol_image_write_begin();
 		memcpy(piDev_g.ai8uPI + revpi_dev->i16uInputOffset, rcv_buf,
 		       AIO_INPUT_DATA_LEN);
+		picontrol_image_write_end();
 		rt_mutex_unlock(&piDev_g.lockPI);
 	}
 
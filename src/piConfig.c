@@ -1,8 +1,13 @@
 // SPDX-License-Identifier: GPL-2.0-only
 // SPDX-FileCopyrightText: 2016-2024 KUNBUS GmbH
 
+#include <linux/crc32.h>
+#include <linux/debugfs.h>
 #include <linux/fs.h>
+#include <linux/log2.h>
+#include <linux/moduleparam.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
 
 #include "common_define.h"
 #include "json.h"
@@ -22,28 +27,13 @@
 #define TOKEN_OUTPUT        "out"
 #define TOKEN_MEMORY        "mem"
 #define TOKEN_CONFIG        "config"
+#define TOKEN_CYCLE_DIVIDER "cycleDivider"
 #define TOKEN_OFFSET        "offset"
 #define TOKEN_SRC_GUID      "srcGUID"
 #define TOKEN_SRC_NAME      "srcAttrname"
 #define TOKEN_DEST_GUID     "destGUID"
 #define TOKEN_DEST_NAME     "destAttrname"
 
-struct json_val_elem {
-	char *key;
-	uint32_t key_length;
-	struct json_val *val;
-};
-
-typedef struct json_val {
-	int type;
-	int length;
-	union {
-		char *data;
-		struct json_val **array;
-		struct json_val_elem **object;
-	} u;
-} json_val_t;
-
 char *string_of_errors[] = {
 	[JSON_ERROR_NO_MEMORY] = "out of memory",
 	[JSON_ERROR_BAD_CHAR] = "bad character",
@@ -59,6 +49,134 @@ char *string_of_errors[] = {
 	[JSON_ERROR_CALLBACK] = "error in a callback"
 };
 
+/*
+ * Everything that is only needed while the configuration is parsed (the
+ * buffers of the JSON parser and the growing arrays of the loader) is taken
+ * from an arena of large chunks, which is freed in one go at the end of
+ * piConfigParse(). The results are copied to allocations of their final
+ * size. Configurations are never parsed concurrently, so there is a single
+ * arena.
+ */
+#define CONFIG_ARENA_CHUNK	(16 * 1024)
+
+struct config_arena_chunk {
+	struct config_arena_chunk *next;
+	size_t size;		// usable bytes in data
+	size_t used;
+	u8 data[] __aligned(8);
+};
+
+/* stored in front of each allocation for config_realloc() */
+struct config_arena_hdr {
+	size_t size;
+} __aligned(8);
+
+static struct {
+	struct config_arena_chunk *chunks;	// the current chunk first
+	size_t size;		// bytes of all chunks
+	void *last;		// last allocation, may grow in place
+} config_arena_s;
+
+static u64 config_mem_last_s;	// arena size of the last parse in bytes
+static u64 config_mem_peak_s;	// maximum of all parses
+
+static void *config_alloc(size_t size)
+{
+	struct config_arena_chunk *c = config_arena_s.chunks;
+	struct config_arena_hdr *hdr;
+	size_t need = sizeof(*hdr) + ALIGN(size, 8);
+	size_t csize;
+
+	if (!c || c->size - c->used < need) {
+		csize = max_t(size_t, CONFIG_ARENA_CHUNK,
+			      PAGE_ALIGN(sizeof(*c) + need));
+		c = kvmalloc(csize, GFP_KERNEL);
+		if (!c)
+			return NULL;
+		c->size = csize - sizeof(*c);
+		c->used = 0;
+		c->next = config_arena_s.chunks;
+		config_arena_s.chunks = c;
+		config_arena_s.size += csize;
+	}
+
+	hdr = (struct config_arena_hdr *) &c->data[c->used];
+	hdr->size = size;
+	c->used += need;
+	config_arena_s.last = hdr + 1;
+	return hdr + 1;
+}
+
+static void *config_calloc(size_t nmemb, size_t size)
+{
+	void *p;
+
+	if (size && nmemb > SIZE_MAX / size)
+		return NULL;
+	p = config_alloc(nmemb * size);
+	if (p)
+		memset(p, 0, nmemb * size);
+	return p;
+}
+
+static void *config_realloc(void *ptr, size_t size)
+{
+	struct config_arena_chunk *c = config_arena_s.chunks;
+	struct config_arena_hdr *hdr;
+	size_t offset;
+	void *p;
+
+	if (!ptr)
+		return config_alloc(size);
+
+	hdr = (struct config_arena_hdr *) ptr - 1;
+	if (ptr == config_arena_s.last) {
+		offset = (u8 *) ptr - c->data;
+		if (offset + ALIGN(size, 8) <= c->size) {
+			c->used = offset + ALIGN(size, 8);
+			hdr->size = size;
+			return ptr;
+		}
+	}
+
+	p = config_alloc(size);
+	if (p)
+		memcpy(p, ptr, min(hdr->size, size));
+	return p;
+}
+
+/* only the last allocation is given back, the rest with the whole arena */
+static void config_free(void *ptr)
+{
+	struct config_arena_chunk *c = config_arena_s.chunks;
+
+	if (ptr && ptr == config_arena_s.last) {
+		c->used = (u8 *) ptr - sizeof(struct config_arena_hdr) - c->data;
+		config_arena_s.last = NULL;
+	}
+}
+
+static void config_arena_release(void)
+{
+	struct config_arena_chunk *c, *next;
+
+	config_mem_last_s = config_arena_s.size;
+	config_mem_peak_s = max(config_mem_peak_s, config_mem_last_s);
+
+	for (c = config_arena_s.chunks; c; c = next) {
+		next = c->next;
+		kvfree(c);
+	}
+	memset(&config_arena_s, 0, sizeof(config_arena_s));
+}
+
+void piConfigDebugfsInit(struct dentry *parent)
+{
+	debugfs_create_u64("config_memory", 0444, parent, &config_mem_last_s);
+	debugfs_create_u64("config_memory_peak", 0444, parent,
+			   &config_mem_peak_s);
+}
+
 struct file *open_filename(const char *filename, int flags)
 {
 	struct file *input;
@@ -85,7 +203,7 @@ int process_file(json_parser * parser, struct file *input, int *retlines, int *r
 	char *buffer;
 	uint32_t processed;
 
-	buffer = kmalloc(BUFFLEN, GFP_KERNEL);
+	buffer = config_alloc(BUFFLEN);
 	if (buffer == NULL) {
 		pr_err("process file: out of memory\n");
 		return JSON_ERROR_NO_MEMORY;
@@ -130,138 +248,415 @@ int process_file(json_parser * parser, struct file *input, int *retlines, int *r
 		*retlines = lines;
 	if (retcols)
 		*retcols = col;
-	kfree(buffer);
+	config_free(buffer);
 	return ret;
 }
 
-static void *tree_create_structure(int is_object)
+/*
+ * The configuration is read in a single pass. The callback of the JSON
+ * parser fills the devices, entries and connections directly instead of
+ * building a tree of the whole file first. Only these values are evaluated:
+ *
+ *	{ "Devices": [ { "productType": ..., "position": ..., "offset": ...,
+ *			 "cycleDivider": ...,
+ *			 "inp": { "0": [ name, default, bit length, offset,
+ *					 exported, ..., ..., bit position ],
+ *				  ... },
+ *			 "out": ..., "mem": ..., "config": ... }, ... ],
+ *	  "Connections": [ { "srcAttrname": ..., "destAttrname": ... }, ... ] }
+ */
+enum config_ctx {
+	CTX_NONE,		// not evaluated
+	CTX_ROOT,
+	CTX_DEVICES,
+	CTX_DEVICE,
+	CTX_VARIABLES,		// "inp", "out", "mem" or "config" of a device
+	CTX_VARIABLE,
+	CTX_CONNECTIONS,
+	CTX_CONNECTION,
+};
+
+#define CONFIG_MAX_DEPTH	8	// deeper values are never evaluated
+#define CONFIG_MIN_ALLOC	16	// initial number of devices, entries or connections
+
+struct config_conn_names {
+	char src[32];
+	char dst[32];
+};
+
+struct config_loader {
+	u8 ctx[CONFIG_MAX_DEPTH];	// context of each open object or array
+	unsigned int depth;	// number of open objects and arrays
+	char key[32];		// last key, empty if it was too long
+	int error;		// error in the structure of the configuration
+
+	piDevices *devs;	// NULL until "Devices" was found
+	unsigned int devs_size;
+	piEntries *ent;
+	unsigned int ent_size;
+	struct config_conn_names *conn;
+	unsigned int conn_cnt;
+	unsigned int conn_size;
+	bool conn_found;
+	piConnectionList *connl;	// already resolved, see load_image()
+
+	u8 type;		// entry type of the current CTX_VARIABLES
+	u16 index;		// number of keys in the current CTX_VARIABLES
+	unsigned int elem;	// next element of the current CTX_VARIABLE
+	u8 bitpos;		// bit position of the current CTX_VARIABLE
+};
+
+/*
+ * Make room for one more element. The arrays grow exponentially in the
+ * arena and are copied to their final size at the end.
+ */
+static void *loader_grow(void *p, unsigned int *size, unsigned int cnt,
+			 size_t hdr, size_t elem)
 {
-	json_val_t *v = kmalloc(sizeof(json_val_t), GFP_KERNEL);
-	if (v) {
-		/* instead of defining a new enum type, we abuse the
-		 * meaning of the json enum type for array and object */
-		if (is_object) {
-			v->type = JSON_OBJECT_BEGIN;
-			v->u.object = NULL;
-		} else {
-			v->type = JSON_ARRAY_BEGIN;
-			v->u.array = NULL;
-		}
+	unsigned int new_size;
+
+	if (p && cnt < *size)
+		return p;
 
-		v->length = 0;
+	new_size = max(2 * *size, (unsigned int) CONFIG_MIN_ALLOC);
+	p = config_realloc(p, hdr + new_size * elem);
+	if (p)
+		*size = new_size;
+	return p;
+}
+
+static int loader_add_device(struct config_loader *ld)
+{
+	unsigned int n = ld->devs->i16uNumDevices;
+	piDevices *devs;
+
+	if (n >= U16_MAX)
+		return JSON_ERROR_DATA_LIMIT;
+
+	devs = loader_grow(ld->devs, &ld->devs_size, n, sizeof(piDevices),
+			   sizeof(SDeviceInfo));
+	if (!devs)
+		return JSON_ERROR_NO_MEMORY;
+	ld->devs = devs;
+
+	memset(&devs->dev[n], 0, sizeof(SDeviceInfo));
+	devs->dev[n].i16uFirstEntry = ld->ent ? ld->ent->i16uNumEntries : 0;
+	devs->i16uNumDevices++;
+	return 0;
+}
+
+static int loader_add_entry(struct config_loader *ld)
+{
+	unsigned int n = ld->ent ? ld->ent->i16uNumEntries : 0;
+	piEntries *ent;
+
+	/* the name index stores the entry index + 1 in a u16 */
+	if (n >= U16_MAX - 1)
+		return JSON_ERROR_DATA_LIMIT;
+
+	ent = loader_grow(ld->ent, &ld->ent_size, n, sizeof(piEntries),
+			  sizeof(SEntryInfo));
+	if (!ent)
+		return JSON_ERROR_NO_MEMORY;
+	if (!ld->ent)
+		memset(ent, 0, sizeof(piEntries));
+	ld->ent = ent;
+
+	memset(&ent->ent[n], 0, sizeof(SEntryInfo));
+	ent->ent[n].i8uType = ld->type;
+	ent->ent[n].i16uIndex = ld->index - 1;
+	ent->i16uNumEntries++;
+	ld->elem = 0;
+	ld->bitpos = 0;
+	return 0;
+}
+
+static int loader_add_connection(struct config_loader *ld)
+{
+	struct config_conn_names *conn;
+
+	if (ld->conn_cnt >= U16_MAX)
+		return JSON_ERROR_DATA_LIMIT;
+
+	conn = loader_grow(ld->conn, &ld->conn_size, ld->conn_cnt, 0,
+			   sizeof(*conn));
+	if (!conn)
+		return JSON_ERROR_NO_MEMORY;
+	ld->conn = conn;
+
+	memset(&conn[ld->conn_cnt++], 0, sizeof(*conn));
+	return 0;
+}
+
+static u32 parse_default(const char *s)
+{
+	u32 val;
+	s32 sval;
+
+	if (kstrtou32(s, 0, &val) == 0)
+		return val;
+	// if parsing as unsigned failed, try it as signed number
+	if (kstrtos32(s, 0, &sval) == 0)
+		return sval;
+	// try binary representation
+	if (s[0] == '0' && s[1] == 'b') {
+		if (kstrtou32(s + 2, 2, &val) == 0)
+			return val;
+	} else if (s[0] == '-' && s[1] == '0' && s[2] == 'b') {
+		if (kstrtou32(s + 3, 2, &val) == 0)
+			return val;
+	}
+	// use default value 0
+	return 0;
+}
+
+static void loader_device_value(struct config_loader *ld, const char *data)
+{
+	SDeviceInfo *dev = &ld->devs->dev[ld->devs->i16uNumDevices - 1];
+
+	if (strcmp(ld->key, TOKEN_TYPE) == 0) {
+		if (kstrtou16(data, 0, &dev->i16uModuleType) != 0)
+			dev->i16uModuleType = 0;
+	} else if (strcmp(ld->key, TOKEN_POSITION) == 0) {
+		if (kstrtou8(data, 0, &dev->i8uAddress) != 0)
+			dev->i8uAddress = 0;
+	} else if (strcmp(ld->key, TOKEN_OFFSET) == 0) {
+		if (kstrtou16(data, 0, &dev->i16uBaseOffset) != 0)
+			dev->i16uBaseOffset = 0;
+	} else if (strcmp(ld->key, TOKEN_CYCLE_DIVIDER) == 0) {
+		if (kstrtou8(data, 0, &dev->i8uCycleDivider) != 0)
+			dev->i8uCycleDivider = 0;
 	}
-	return v;
 }
 
-static char *memalloc_copy_length(const char *src, uint32_t n)
+static void loader_variable_value(struct config_loader *ld, int type,
+				  const char *data)
 {
-	char *dest;
+	SEntryInfo *ent = &ld->ent->ent[ld->ent->i16uNumEntries - 1];
+
+	switch (ld->elem++) {
+	case 0:
+		strncpy(ent->strVarName, data, sizeof(ent->strVarName) - 1);
+		ent->strVarName[sizeof(ent->strVarName) - 1] = 0;
+		break;
+	case 1:
+		ent->i32uDefault = parse_default(data);
+		break;
+	case 2:
+		if (kstrtou16(data, 0, &ent->i16uBitLength) != 0)
+			ent->i16uBitLength = 0;
+		break;
+	case 3:
+		if (kstrtou16(data, 0, &ent->i16uOffset) != 0)
+			ent->i16uOffset = 0;
+		break;
+	case 4:
+		if (type == JSON_TRUE ||
+		    (type == JSON_STRING && strcmp(data, "true") == 0))
+			ent->i8uType |= 0x80;	// flag for exported variables
+		break;
+	case 7:
+		if (kstrtou8(data, 0, &ld->bitpos) != 0)
+			ld->bitpos = 0;
+		break;
+	}
+}
 
-	dest = kmalloc((n + 1) * sizeof(char), GFP_KERNEL);
-	if (dest) {
-		memcpy(dest, src, n);
-		dest[n] = 0;
+static void loader_connection_value(struct config_loader *ld, const char *data)
+{
+	struct config_conn_names *conn = &ld->conn[ld->conn_cnt - 1];
+
+	// The variable name are unique in th whole configuration, therefore it is not necessary to compare the GUIDs
+	// also. This is guaranteed by PiCtory.
+	if (strcmp(ld->key, TOKEN_SRC_NAME) == 0) {
+		strncpy(conn->src, data, sizeof(conn->src) - 1);
+		conn->src[sizeof(conn->src) - 1] = 0;
+	} else if (strcmp(ld->key, TOKEN_DEST_NAME) == 0) {
+		strncpy(conn->dst, data, sizeof(conn->dst) - 1);
+		conn->dst[sizeof(conn->dst) - 1] = 0;
 	}
-	return dest;
 }
 
-static void *tree_create_data(int type, const char *data, uint32_t length)
+/* Context of a new object or array in the current context */
+static int loader_begin(struct config_loader *ld, u8 cur, bool is_object,
+			u8 *ctx)
 {
-	json_val_t *v;
+	*ctx = CTX_NONE;
 
-	v = kmalloc(sizeof(json_val_t), GFP_KERNEL);
-	if (v) {
-		v->type = type;
-		v->length = length;
-		v->u.data = memalloc_copy_length(data, length);
-		if (!v->u.data) {
-			kfree(v);
-			return NULL;
+	switch (cur) {
+	case CTX_ROOT:
+		if (is_object)
+			break;
+		if (strcmp(ld->key, TOKEN_DEVICES) == 0) {
+			if (ld->devs) {
+				pr_err("error: there should by only one '%s' element\n",
+				       TOKEN_DEVICES);
+				ld->error = 1;
+				break;
+			}
+			ld->devs = loader_grow(NULL, &ld->devs_size, 0,
+					       sizeof(piDevices),
+					       sizeof(SDeviceInfo));
+			if (!ld->devs)
+				return JSON_ERROR_NO_MEMORY;
+			ld->devs->i16uNumDevices = 0;
+			*ctx = CTX_DEVICES;
+		} else if (strcmp(ld->key, TOKEN_CONNECTIONS) == 0) {
+			if (ld->conn_found) {
+				pr_err("error: there should by only one '%s' element\n",
+				       TOKEN_CONNECTIONS);
+				ld->error = 1;
+				break;
+			}
+			ld->conn_found = true;
+			*ctx = CTX_CONNECTIONS;
 		}
+		break;
+	case CTX_DEVICES:
+		if (!is_object)
+			break;
+		*ctx = CTX_DEVICE;
+		return loader_add_device(ld);
+	case CTX_DEVICE:
+		if (!is_object)
+			break;
+		if (strcmp(ld->key, TOKEN_INPUT) == 0)
+			ld->type = 1;
+		else if (strcmp(ld->key, TOKEN_OUTPUT) == 0)
+			ld->type = 2;
+		else if (strcmp(ld->key, TOKEN_MEMORY) == 0)
+			ld->type = 3;
+		else if (strcmp(ld->key, TOKEN_CONFIG) == 0)
+			ld->type = 4;
+		else
+			break;
+		ld->index = 0;
+		*ctx = CTX_VARIABLES;
+		break;
+	case CTX_VARIABLES:
+		if (is_object)
+			break;
+		*ctx = CTX_VARIABLE;
+		return loader_add_entry(ld);
+	case CTX_VARIABLE:
+		ld->elem++;	// nested values are skipped
+		break;
+	case CTX_CONNECTIONS:
+		if (!is_object)
+			break;
+		*ctx = CTX_CONNECTION;
+		return loader_add_connection(ld);
 	}
-	return v;
+
+	return 0;
 }
 
-static int tree_append(void *structure, char *key, uint32_t key_length, void *obj)
+static void loader_end(struct config_loader *ld, u8 cur)
 {
-	json_val_t *parent = structure;
-	if (key) {
-		struct json_val_elem *objelem;
+	SDeviceInfo *dev;
+	SEntryInfo *ent;
+	int i;
 
-		if (parent->length == 0) {
-			parent->u.object = kmalloc((1 + 1) * sizeof(json_val_t *), GFP_KERNEL);	/* +1 for null */
-			if (!parent->u.object)
-				return 1;
-			memset(parent->u.object, 0, 2 * sizeof(json_val_t *));
-		} else {
-			uint32_t newsize = parent->length + 1 + 1;	/* +1 for null */
-			void *newptr;
+	switch (cur) {
+	case CTX_DEVICE:
+		dev = &ld->devs->dev[ld->devs->i16uNumDevices - 1];
+		dev->i16uEntries = (ld->ent ? ld->ent->i16uNumEntries : 0) -
+			dev->i16uFirstEntry;
+		// the position may follow the variables
+		for (i = 0; i < dev->i16uEntries; i++)
+			ld->ent->ent[dev->i16uFirstEntry + i].i8uAddress =
+				dev->i8uAddress;
+		break;
+	case CTX_VARIABLE:
+		ent = &ld->ent->ent[ld->ent->i16uNumEntries - 1];
+		// the bit position is only used for single bits
+		ent->i8uBitPos = ent->i16uBitLength == 1 ? ld->bitpos : 0;
+		break;
+	}
+}
 
-			newptr = krealloc(parent->u.object, newsize * sizeof(json_val_t *), GFP_KERNEL);
-			if (!newptr)
-				return -1;
-			parent->u.object = newptr;
-		}
+static int loader_callback(void *userdata, int type, const char *data,
+			   uint32_t length)
+{
+	struct config_loader *ld = userdata;
+	u8 cur = CTX_NONE;
+	u8 ctx;
+	int ret;
 
-		objelem = kmalloc(sizeof(struct json_val_elem), GFP_KERNEL);
-		if (!objelem)
-			return -1;
-
-		objelem->key = memalloc_copy_length(key, key_length);
-		objelem->key_length = key_length;
-		objelem->val = obj;
-		parent->u.object[parent->length++] = objelem;
-		parent->u.object[parent->length] = NULL;
-	} else {
-		if (parent->length == 0) {
-			parent->u.array = kmalloc((1 + 1) * sizeof(json_val_t *), GFP_KERNEL);	/* +1 for null */
-			if (!parent->u.array)
-				return 1;
-			memset(parent->u.array, 0, (1 + 1) * sizeof(json_val_t *));
-		} else {
-			uint32_t newsize = parent->length + 1 + 1;	/* +1 for null */
-			void *newptr;
+	if (ld->depth && ld->depth <= CONFIG_MAX_DEPTH)
+		cur = ld->ctx[ld->depth - 1];
+	if (!data)
+		data = "";
 
-			newptr = krealloc(parent->u.object, newsize * sizeof(json_val_t *), GFP_KERNEL);
-			if (!newptr)
-				return -1;
-			parent->u.array = newptr;
+	switch (type) {
+	case JSON_OBJECT_BEGIN:
+	case JSON_ARRAY_BEGIN:
+		if (ld->depth == 0) {
+			ctx = type == JSON_OBJECT_BEGIN ? CTX_ROOT : CTX_NONE;
+		} else {
+			ret = loader_begin(ld, cur, type == JSON_OBJECT_BEGIN,
+					   &ctx);
+			if (ret)
+				return ret;
 		}
-		parent->u.array[parent->length++] = obj;
-		parent->u.array[parent->length] = NULL;
+		if (ld->depth < CONFIG_MAX_DEPTH)
+			ld->ctx[ld->depth] = ctx;
+		ld->depth++;
+		break;
+	case JSON_OBJECT_END:
+	case JSON_ARRAY_END:
+		loader_end(ld, cur);
+		ld->depth--;
+		break;
+	case JSON_KEY:
+		if (length < sizeof(ld->key))
+			memcpy(ld->key, data, length + 1);
+		else
+			ld->key[0] = 0;
+		if (cur == CTX_VARIABLES)
+			ld->index++;
+		break;
+	default:
+		if (cur == CTX_DEVICE)
+			loader_device_value(ld, data);
+		else if (cur == CTX_VARIABLE)
+			loader_variable_value(ld, type, data);
+		else if (cur == CTX_CONNECTION)
+			loader_connection_value(ld, data);
+		break;
 	}
+
 	return 0;
 }
 
-static int do_tree(json_config *config,
-			const char *filename,
-			json_val_t **root_structure)
+static int load_config(const char *filename, struct config_loader *ld)
 {
 	struct file *input;
+	json_config config;
 	json_parser parser;
-	json_parser_dom dom;
 	int ret;
 	int col, lines;
 
+	memset(&config, 0, sizeof(json_config));
+	config.max_nesting = 0;
+	config.max_data = 0;
+	config.allow_c_comments = 1;
+	config.allow_yaml_comments = 1;
+	config.user_calloc = config_calloc;
+	config.user_realloc = config_realloc;
+	config.user_free = config_free;
+
+	memset(ld, 0, sizeof(*ld));
+
 	input = open_filename(filename, O_RDONLY);
 	if (!input)
 		return 2;
 
-	ret = json_parser_dom_init(&dom,
-					tree_create_structure,
-					tree_create_data,
-					tree_append);
-	if (ret) {
-		pr_err("error: initializing helper failed: [code=%d] %s\n",
-						ret, string_of_errors[ret]);
-		goto close_file;
-	}
-
-	ret = json_parser_init(&parser, config, json_parser_dom_callback, &dom);
+	ret = json_parser_init(&parser, &config, loader_callback, ld);
 	if (ret) {
 		pr_err("error: initializing parser failed: [code=%d] %s\n",
 						ret, string_of_errors[ret]);
-		goto free_dom;
+		goto close_file;
 	}
 
 	ret = process_file(&parser, input, &lines, &col);
@@ -282,14 +677,9 @@ static int do_tree(json_config *config,
 		goto free_parser;
 	}
 
-	if (root_structure)
-		*root_structure = dom.root_structure;
-
 	/* cleanup */
 free_parser:
 	json_parser_free(&parser);
-free_dom:
-	json_parser_dom_free(&dom);
 
 close_file:
 	close_filename(input);
@@ -297,438 +687,280 @@ close_file:
 	return ret;
 }
 
-static int free_tree(json_val_t * element)
+/*
+ * Look up the variables of the connections, after all entries are known and
+ * the name index is built.
+ */
+static piConnectionList *resolve_connections(struct config_loader *ld, piEntries *ent)
 {
+	struct config_conn_names *names;
+	SEntryInfo *pSrcEntry, *pDstEntry;
+	piConnectionList *connl;
+	piConnection *conn;
 	int i;
-	if (!element) {
-		pr_err("error: no element in print tree\n");
-		return -1;
-	}
 
-	switch (element->type) {
-	case JSON_OBJECT_BEGIN:
-		for (i = 0; i < element->length; i++) {
-			free_tree(element->u.object[i]->val);
-			kfree(element->u.object[i]->key);
-			kfree(element->u.object[i]);
+	if (!ld->conn_found)
+		return NULL;
+	if (ld->connl)
+		return kmemdup(ld->connl, sizeof(piConnectionList) +
+			       ld->connl->i16uNumEntries * sizeof(piConnection),
+			       GFP_KERNEL);
+
+	connl = kzalloc(sizeof(piConnectionList) + ld->conn_cnt * sizeof(piConnection), GFP_KERNEL);
+	if (!connl)
+		return NULL;
+	connl->i16uNumEntries = ld->conn_cnt;
+
+	for (i = 0; i < ld->conn_cnt; i++) {
+		names = &ld->conn[i];
+		conn = &connl->conn[i];
+
+		if (names->src[0] == 0 || names->dst[0] == 0) {
+			pr_err("error: attributes of connection %d are missing\n", i + 1);
+			continue;
 		}
-		kfree(element->u.object);
-		break;
-	case JSON_ARRAY_BEGIN:
-		for (i = 0; i < element->length; i++) {
-			free_tree(element->u.array[i]);
+		pSrcEntry = piConfigFindEntry(ent, names->src);
+		if (pSrcEntry == NULL) {
+			pr_err("error: connection variable %s unknown\n", names->src);
+			continue;
+		}
+		pDstEntry = piConfigFindEntry(ent, names->dst);
+		if (pDstEntry == NULL) {
+			pr_err("error: connection variable %s unknown\n", names->dst);
+			continue;
+		}
+		conn->i16uSrcAddr = pSrcEntry->i16uOffset;
+		conn->i16uDestAddr = pDstEntry->i16uOffset;
+		conn->i8uLength = pSrcEntry->i16uBitLength;
+		if (conn->i8uLength < 8) {
+			conn->i8uSrcBit = pSrcEntry->i8uBitPos;
+			conn->i8uDestBit = pDstEntry->i8uBitPos;
+		} else {
+			conn->i8uSrcBit = 0;
+			conn->i8uDestBit = 0;
 		}
-		kfree(element->u.array);
-		break;
-	case JSON_FALSE:
-	case JSON_TRUE:
-	case JSON_NULL:
-	case JSON_INT:
-	case JSON_STRING:
-	case JSON_FLOAT:
-		kfree(element->u.data);
-		break;
-	default:
-		break;
 	}
 
-	kfree(element);
+	return connl;
+}
 
-	return 0;
+/*
+ * The name index is a hash table with open addressing. Each slot holds the
+ * index + 1 of an entry in piEntries, 0 marks a free slot. At most half of
+ * the slots are used to keep the probe sequences short.
+ */
+static unsigned int name_index_size(unsigned int entries)
+{
+	return roundup_pow_of_two(max(2 * entries, 2U));
 }
 
-static piDevices *find_devices(json_val_t * element, SDeviceInfo * pDev, int lvl)
+static u32 name_hash(const char *name)
 {
-	int i;
-	piDevices *ret = NULL;
+	u32 hash = 2166136261U;		/* FNV-1a */
 
-	if (!element) {
-		pr_err("error: no element in print tree\n");
-		return NULL;
+	while (*name) {
+		hash ^= (u8) *name++;
+		hash *= 16777619U;
 	}
 
-	switch (element->type) {
-	case JSON_OBJECT_BEGIN:
-		if (lvl == 200) {
-			pDev->i16uEntries += element->length;
-		} else {
-			for (i = 0; i < element->length; i++) {
-				if (lvl == 1 && strcmp(element->u.object[i]->key, TOKEN_DEVICES) == 0) {	// we found the devices list -> increase lvl
-					if (ret != NULL) {
-						pr_err("error: there should by only one '%s' element\n",
-							  element->u.object[i]->key);
-						return NULL;
-					}
-					ret = find_devices(element->u.object[i]->val, NULL, 100);
-				} else if (lvl == 101) {	// we found a device, parse elements
-					if (strcmp(element->u.object[i]->key, TOKEN_TYPE) == 0) {
-						if (kstrtou16(element->u.object[i]->val->u.data, 0, &pDev->i16uModuleType) != 0)
-							pDev->i16uModuleType = 0;
-					} else if (strcmp(element->u.object[i]->key, TOKEN_POSITION) == 0) {
-						if (kstrtou8(element->u.object[i]->val->u.data, 0, &pDev->i8uAddress) != 0)
-							pDev->i8uAddress = 0;
-					} else if (strcmp(element->u.object[i]->key, TOKEN_OFFSET) == 0) {
-						if (kstrtou16(element->u.object[i]->val->u.data, 0, &pDev->i16uBaseOffset) != 0)
-							pDev->i16uBaseOffset = 0;
-					} else if (strcmp(element->u.object[i]->key, TOKEN_INPUT) == 0) {
-						ret = find_devices(element->u.object[i]->val, pDev, 200);
-					} else if (strcmp(element->u.object[i]->key, TOKEN_OUTPUT) == 0) {
-						ret = find_devices(element->u.object[i]->val, pDev, 200);
-					} else if (strcmp(element->u.object[i]->key, TOKEN_MEMORY) == 0) {
-						ret = find_devices(element->u.object[i]->val, pDev, 200);
-					} else if (strcmp(element->u.object[i]->key, TOKEN_CONFIG) == 0) {
-						ret = find_devices(element->u.object[i]->val, pDev, 200);
-					} else {
-						ret = find_devices(element->u.object[i]->val, NULL, lvl + 1);
-					}
-				} else {
-					// the other objects are not processed
-					//ret = find_devices(element->u.object[i]->val, NULL, lvl + 1);
-				}
-			}
-		}
-		break;
-	case JSON_ARRAY_BEGIN:
-		if (lvl == 100) {
-			int entries = 0;
-			ret = kzalloc(sizeof(piDevices) +
-				      element->length * sizeof(SDeviceInfo),
-				      GFP_KERNEL);
-			if (!ret)
-				return NULL;
-			ret->i16uNumDevices = element->length;
-			for (i = 0; i < element->length; i++) {
-				ret->dev[i].i16uFirstEntry = entries;
-				find_devices(element->u.array[i], &ret->dev[i], lvl + 1);
-				entries += ret->dev[i].i16uEntries;
-			}
-		} else {
-			for (i = 0; i < element->length; i++) {
-				ret = find_devices(element->u.array[i], 0, lvl + 1);
-			}
-		}
-		break;
-		break;
-	case JSON_FALSE:
-	case JSON_TRUE:
-	case JSON_NULL:
-		break;
-	case JSON_INT:
-		break;
-	case JSON_STRING:
-		break;
-	case JSON_FLOAT:
-		break;
-	default:
-		pr_err("error: unhandled type %d\n", element->type);
-		break;
-	}
-	return ret;
+	return hash;
 }
 
-static void find_entries(json_val_t * element, piEntries * pEnt, int *pIdxEntry, int devAddr, int type, int lvl)
+static void build_name_index(piEntries *ent)
 {
+	u32 mask = ent->i32uNameIndexMask;
+	u32 slot;
 	int i;
 
-	if (!element) {
-		pr_err("error: no element in print tree\n");
-		return;
+	memset(ent->pi16uNameIndex, 0, (mask + 1) * sizeof(u16));
+
+	/*
+	 * Entries are inserted in ascending order, so for duplicate names the
+	 * first entry is found first, like with a linear search.
+	 */
+	for (i = 0; i < ent->i16uNumEntries; i++) {
+		if (!ent->ent[i].strVarName[0])
+			continue;
+
+		slot = name_hash(ent->ent[i].strVarName) & mask;
+		while (ent->pi16uNameIndex[slot])
+			slot = (slot + 1) & mask;
+		ent->pi16uNameIndex[slot] = i + 1;
 	}
+}
 
-	switch (element->type) {
-	case JSON_OBJECT_BEGIN:
-		for (i = 0; i < element->length; i++) {
-			if (lvl == 1 && strcmp(element->u.object[i]->key, TOKEN_DEVICES) == 0) {	// we found the devices list -> increase lvl
-				find_entries(element->u.object[i]->val, pEnt, pIdxEntry, devAddr, type, 100);
-			} else if (lvl == 101) {	// we found a device, parse elements
-				if (strcmp(element->u.object[i]->key, TOKEN_POSITION) == 0) {
-					if (kstrtoint(element->u.object[i]->val->u.data, 0, &devAddr) != 0)
-						devAddr = 0;
-				} else if (strcmp(element->u.object[i]->key, TOKEN_INPUT) == 0) {
-					find_entries(element->u.object[i]->val, pEnt, pIdxEntry, devAddr, 1, 200);
-				} else if (strcmp(element->u.object[i]->key, TOKEN_OUTPUT) == 0) {
-					find_entries(element->u.object[i]->val, pEnt, pIdxEntry, devAddr, 2, 200);
-				} else if (strcmp(element->u.object[i]->key, TOKEN_MEMORY) == 0) {
-					find_entries(element->u.object[i]->val, pEnt, pIdxEntry, devAddr, 3, 200);
-				} else if (strcmp(element->u.object[i]->key, TOKEN_CONFIG) == 0) {
-					find_entries(element->u.object[i]->val, pEnt, pIdxEntry, devAddr, 4, 200);
-				} else {
-					find_entries(element->u.object[i]->val, pEnt, pIdxEntry, devAddr, type,
-						     lvl + 1);
-				}
-			} else if (lvl == 200) {
-				if (element->u.object[i]->val->type == JSON_ARRAY_BEGIN) {
-					struct json_val **array = element->u.object[i]->val->u.array;
-
-					if (*pIdxEntry >= pEnt->i16uNumEntries) {
-						pr_err("error: wrong entry index\n");
-						return;
-					}
-					pEnt->ent[*pIdxEntry].i8uAddress = devAddr;
-					pEnt->ent[*pIdxEntry].i8uType = type;
-					pEnt->ent[*pIdxEntry].i16uIndex = i;
-					if (kstrtou16(array[2]->u.data, 0, &pEnt->ent[*pIdxEntry].i16uBitLength) != 0)
-						pEnt->ent[*pIdxEntry].i16uBitLength = 0;
-					if (pEnt->ent[*pIdxEntry].i16uBitLength == 1) {
-						if (kstrtou8(array[7]->u.data, 0, &pEnt->ent[*pIdxEntry].i8uBitPos) != 0)
-							pEnt->ent[*pIdxEntry].i8uBitPos = 0;
-					} else {
-						pEnt->ent[*pIdxEntry].i8uBitPos = 0;	// default for whole bytes
-					}
-					if (kstrtou16(array[3]->u.data, 0, &pEnt->ent[*pIdxEntry].i16uOffset) != 0)
-						pEnt->ent[*pIdxEntry].i16uOffset = 0;
-					if (kstrtou32(array[1]->u.data, 0, &pEnt->ent[*pIdxEntry].i32uDefault) != 0) {
-						// if parsing as unsigned failed, try it as signed number
-						if (kstrtos32(array[1]->u.data, 0, &pEnt->ent[*pIdxEntry].i32uDefault) != 0) {
-							// try binary representation
-							if (array[1]->u.data[0] == '0' && array[1]->u.data[1] == 'b') {
-								if (kstrtou32(array[1]->u.data+2, 2, &pEnt->ent[*pIdxEntry].i32uDefault) != 0) {
-									// failed also, use default value 0
-									pEnt->ent[*pIdxEntry].i32uDefault = 0;
-								}
-							} else if (array[1]->u.data[0] == '-' && array[1]->u.data[1] == '0' && array[1]->u.data[2] == 'b') {
-								if (kstrtou32(array[1]->u.data+3, 2, &pEnt->ent[*pIdxEntry].i32uDefault) != 0) {
-									// failed also, use default value 0
-									pEnt->ent[*pIdxEntry].i32uDefault = 0;
-								}
-							} else {
-								// use default value 0
-								pEnt->ent[*pIdxEntry].i32uDefault = 0;
-							}
-						}
-					}
-					if (array[4]->type == JSON_TRUE ||
-					    (array[4]->type == JSON_STRING && strcmp(array[4]->u.data, "true") == 0)
-					    ) {
-						pEnt->ent[*pIdxEntry].i8uType |= 0x80;	// flag for exported variables
-					}
-					strncpy(pEnt->ent[*pIdxEntry].strVarName, array[0]->u.data,
-						sizeof(pEnt->ent[*pIdxEntry].strVarName) - 1);
-					pEnt->ent[*pIdxEntry].strVarName[sizeof(pEnt->ent[*pIdxEntry].strVarName) - 1] =
-					    0;
-
-					(*pIdxEntry)++;
-				} else {
-					find_entries(element->u.object[i]->val, pEnt, pIdxEntry, devAddr, type,
-						     lvl + 1);
+/*
+ * Compile the sorted and compacted copy list into runs of contiguous bytes
+ * with a mask for each byte. KB_SET_EXPORTED_OUTPUTS copies the span of all
+ * runs with a single copy_from_user() and merges it with the masks.
+ */
+static void build_copy_runs(piCopylist *cl)
+{
+	piCopyRun *run = NULL;
+	unsigned int masks = 0;
+	unsigned int addr, len;
+	u8 mask;
+	int i;
+
+	cl->i16uNumRuns = 0;
+	for (i = 0; i < cl->i16uNumEntries; i++) {
+		if (cl->ent[i].i16uLength >= 8) {
+			len = cl->ent[i].i16uLength / 8;
+			mask = 0xff;
+		} else {
+			len = 1;
+			mask = cl->ent[i].i8uBitMask;
+		}
+
+		if (cl->ent[i].i16uAddr + len > KB_PI_LEN) {
+			pr_err("error: exported output at offset %u is out of range\n",
+			       cl->ent[i].i16uAddr);
+			continue;
+		}
+
+		for (addr = cl->ent[i].i16uAddr; addr < cl->ent[i].i16uAddr + len; addr++) {
+			if (run && addr >= run->i16uAddr &&
+			    addr < run->i16uAddr + run->i16uLength) {
+				cl->pi8uMask[run->i16uMaskOffset + addr - run->i16uAddr] |= mask;
+			} else if (masks < KB_PI_LEN) {
+				if (!run || addr != run->i16uAddr + run->i16uLength) {
+					run = &cl->pRuns[cl->i16uNumRuns++];
+					run->i16uAddr = addr;
+					run->i16uLength = 0;
+					run->i16uMaskOffset = masks;
 				}
-			} else {
-				find_entries(element->u.object[i]->val, pEnt, pIdxEntry, devAddr, type, lvl + 1);
+				cl->pi8uMask[masks++] = mask;
+				run->i16uLength++;
 			}
 		}
-		break;
-	case JSON_ARRAY_BEGIN:
-		for (i = 0; i < element->length; i++) {
-			find_entries(element->u.array[i], pEnt, pIdxEntry, devAddr, type, lvl + 1);
-		}
-		break;
-	case JSON_FALSE:
-	case JSON_TRUE:
-	case JSON_NULL:
-		break;
-	case JSON_INT:
-		break;
-	case JSON_STRING:
-		break;
-	case JSON_FLOAT:
-		break;
-	default:
-		break;
 	}
-}
 
-static SEntryInfo *search_entry(piEntries * ent, char *strName)
-{
-	int i;
-	for (i = 0; i < ent->i16uNumEntries; i++) {
-		if (strcmp(ent->ent[i].strVarName, strName) == 0)
-			return &ent->ent[i];
+	if (!cl->i16uNumRuns)
+		return;
+
+	for (i = 0; i < cl->i16uNumRuns; i++) {
+		run = &cl->pRuns[i];
+		run->i8uFull = memchr_inv(cl->pi8uMask + run->i16uMaskOffset, 0xff,
+					  run->i16uLength) == NULL;
+		pr_debug("cl-run: %2d addr %4d  len %4d  full %d\n", i,
+			 run->i16uAddr, run->i16uLength, run->i8uFull);
 	}
-	return NULL;
+
+	cl->i16uSpanAddr = cl->pRuns[0].i16uAddr;
+	cl->i16uSpanLength = run->i16uAddr + run->i16uLength - cl->i16uSpanAddr;
 }
 
-static piConnectionList *find_connections(json_val_t * element, piDevices * devs, piEntries * ent, piConnection * conn,
-					  int lvl)
+/* Merge the exported outputs in src, which holds the span of the runs. */
+void piCopylistMerge(const piCopylist *cl, u8 *mem, const u8 *src)
 {
-	int i;
-	piConnectionList *ret = NULL;
+	const piCopyRun *run;
+	const u8 *mask, *s;
+	u8 *d;
+	int i, j;
+
+	for (i = 0; i < cl->i16uNumRuns; i++) {
+		run = &cl->pRuns[i];
+		s = src + run->i16uAddr - cl->i16uSpanAddr;
+		d = mem + run->i16uAddr;
+
+		if (run->i8uFull) {
+			memcpy(d, s, run->i16uLength);
+			continue;
+		}
 
-	if (!element) {
-		pr_err("error: no element in print tree\n");
-		return NULL;
+		mask = cl->pi8uMask + run->i16uMaskOffset;
+		for (j = 0; j < run->i16uLength; j++)
+			d[j] = (d[j] & ~mask[j]) | (s[j] & mask[j]);
 	}
+}
 
-	switch (element->type) {
-	case JSON_OBJECT_BEGIN:
-		if (lvl == 200) {
+/* Set all exported outputs to 0. */
+void piCopylistClear(const piCopylist *cl, u8 *mem)
+{
+	const piCopyRun *run;
+	const u8 *mask;
+	u8 *d;
+	int i, j;
 
-		} else {
-			// The variable name are unique in th whole configuration, therefore it is not necessary to compare the GUIDs
-			// also. This is guaranteed by PiCtory.
-//			char strSrcGUID[50];
-//			char strDstGUID[50];
-			char strSrcName[32];
-			char strDstName[32];
-//			strSrcGUID[0] = 0;
-//			strDstGUID[0] = 0;
-			strSrcName[0] = 0;
-			strDstName[0] = 0;
-
-			for (i = 0; i < element->length; i++) {
-				if (lvl == 1 && strcmp(element->u.object[i]->key, TOKEN_CONNECTIONS) == 0) {	// we found the connections list -> increase lvl
-					if (ret != NULL) {
-						pr_err("error: there should by only one '%s' element\n",
-							  element->u.object[i]->key);
-						return NULL;
-					}
-					ret = find_connections(element->u.object[i]->val, devs, ent, conn, 100);
-				} else if (lvl == 101) {	// we found a connection, parse elements
-//					if (strcmp(element->u.object[i]->key, TOKEN_SRC_GUID) == 0)
-//					{
-//						strncpy(strSrcGUID, element->u.object[i]->val->u.data, sizeof(strSrcGUID)-1);
-//						strSrcGUID[sizeof(strSrcGUID)-1] = 0;
-//					}
-//					else if (strcmp(element->u.object[i]->key, TOKEN_DEST_GUID) == 0)
-//					{
-//						strncpy(strDstGUID, element->u.object[i]->val->u.data, sizeof(strDstGUID)-1);
-//						strDstGUID[sizeof(strDstGUID)-1] = 0;
-//					}
-//					else
-					if (strcmp(element->u.object[i]->key, TOKEN_SRC_NAME) == 0) {
-						strncpy(strSrcName, element->u.object[i]->val->u.data,
-							sizeof(strSrcName) - 1);
-						strSrcName[sizeof(strSrcName) - 1] = 0;
-					} else if (strcmp(element->u.object[i]->key, TOKEN_DEST_NAME) == 0) {
-						strncpy(strDstName, element->u.object[i]->val->u.data,
-							sizeof(strDstName) - 1);
-						strDstName[sizeof(strDstName) - 1] = 0;
-					}
-				} else {
-					// the other objects are not processed
-					//ret = find_connections(element->u.object[i]->val, NULL, lvl + 1);
-				}
-			}
+	for (i = 0; i < cl->i16uNumRuns; i++) {
+		run = &cl->pRuns[i];
+		d = mem + run->i16uAddr;
 
-			if (lvl == 101) {
-				if (	/*    strSrcGUID[0] != 0
-					   &&  strDstGUID[0] != 0
-					   && */ strSrcName[0] != 0
-					   && strDstName[0] != 0) {
-					SEntryInfo *pSrcEntry, *pDstEntry;
-					pSrcEntry = search_entry(ent, strSrcName);
-					if (pSrcEntry == NULL) {
-						pr_err("error: connection variable %s unknown\n", strSrcName);
-						return NULL;
-					}
-					pDstEntry = search_entry(ent, strDstName);
-					if (pDstEntry == NULL) {
-						pr_err("error: connection variable %s unknown\n", strDstName);
-						return NULL;
-					}
-					conn->i16uSrcAddr = pSrcEntry->i16uOffset;
-					conn->i16uDestAddr = pDstEntry->i16uOffset;
-					conn->i8uLength = pSrcEntry->i16uBitLength;
-					if (conn->i8uLength < 8) {
-						conn->i8uSrcBit = pSrcEntry->i8uBitPos;
-						conn->i8uDestBit = pDstEntry->i8uBitPos;
-					} else {
-						conn->i8uSrcBit = 0;
-						conn->i8uDestBit = 0;
-					}
-					return NULL;	// return value is not used in this recursive call
-				} else {
-					pr_err("error: attributes of connection %d are missing\n", i + 1);
-					return NULL;
-				}
-			}
-		}
-		break;
-	case JSON_ARRAY_BEGIN:
-		if (lvl == 100) {
-			ret = kzalloc(sizeof(piConnectionList) + element->length * sizeof(piConnection), GFP_KERNEL);
-			if (!ret)
-				return NULL;
-			ret->i16uNumEntries = element->length;
-			for (i = 0; i < element->length; i++) {
-				find_connections(element->u.array[i], devs, ent, &ret->conn[i], lvl + 1);
-			}
-		} else {
-//			for (i = 0; i < element->length; i++)
-//			{
-//				ret = find_connections(element->u.array[i], devs, ent, conn, lvl + 1);
-//			}
+		if (run->i8uFull) {
+			memset(d, 0, run->i16uLength);
+			continue;
 		}
-		break;
-		break;
-	case JSON_FALSE:
-	case JSON_TRUE:
-	case JSON_NULL:
-		break;
-	case JSON_INT:
-		break;
-	case JSON_STRING:
-		break;
-	case JSON_FLOAT:
-		break;
-	default:
-		pr_err("error: unhandled type %d\n", element->type);
-		break;
+
+		mask = cl->pi8uMask + run->i16uMaskOffset;
+		for (j = 0; j < run->i16uLength; j++)
+			d[j] &= ~mask[j];
 	}
-	return ret;
 }
 
-int piConfigParse(const char *filename, piDevices ** devs, piEntries ** ent, piCopylist ** cl,
-		  piConnectionList ** connl)
+SEntryInfo *piConfigFindEntry(piEntries *ent, const char *name)
 {
-	int ret = 0, i, cnt, d, idx[4], exported_outputs;
-	json_config config;
-	json_val_t *root_structure;
-
-	memset(&config, 0, sizeof(json_config));
-	config.max_nesting = 0;
-	config.max_data = 0;
-	config.allow_c_comments = 1;
-	config.allow_yaml_comments = 1;
+	u32 mask = ent->i32uNameIndexMask;
+	u32 slot = name_hash(name) & mask;
+	u16 idx;
+
+	while ((idx = ent->pi16uNameIndex[slot]) != 0) {
+		if (strcmp(ent->ent[idx - 1].strVarName, name) == 0)
+			return &ent->ent[idx - 1];
+		slot = (slot + 1) & mask;
+	}
 
-	*devs = NULL;
-	*ent = NULL;
-	*cl = NULL;
-	*connl = NULL;
+	return NULL;
+}
 
-	ret = do_tree(&config, filename, &root_structure);
-	if (ret)
-		return ret;
+/*
+ * Create the tables of the driver from the devices and entries of a loaded
+ * configuration. If configure_modules is set, the parameters of the modules
+ * are passed to the module drivers, otherwise the running modules are not
+ * touched, see piConfigSameLayout().
+ */
+static int build_config(struct config_loader *ld, piDevices ** devs, piEntries ** ent,
+			piCopylist ** cl, piConnectionList ** connl, bool configure_modules)
+{
+	int ret, i, cnt, d, idx[4], exported_outputs;
+	unsigned int index_size;
 
-	*devs = find_devices(root_structure, NULL, 1);
-	if (*devs == NULL) {
-		pr_err("find_devices returned NULL\n");
+	if (ld->devs == NULL || ld->error) {
+		pr_err("no valid '%s' element found\n", TOKEN_DEVICES);
 		return 3;
 	}
+	*devs = kmemdup(ld->devs, sizeof(piDevices) +
+			ld->devs->i16uNumDevices * sizeof(SDeviceInfo), GFP_KERNEL);
+	if (!*devs)
+		return JSON_ERROR_NO_MEMORY;
 
 	pr_info("found %d devices in configuration file\n", (*devs)->i16uNumDevices);
 
-	cnt = 0;
-	for (i = 0; i < (*devs)->i16uNumDevices; i++)
-		cnt += (*devs)->dev[i].i16uEntries;
+	cnt = ld->ent ? ld->ent->i16uNumEntries : 0;
 	pr_debug("%d entries in total\n", cnt);
 
-	*ent = kzalloc(sizeof(piEntries) + cnt * sizeof(SEntryInfo), GFP_KERNEL);
+	// the name index is stored behind the entries
+	index_size = name_index_size(cnt);
+	*ent = kzalloc(sizeof(piEntries) + cnt * sizeof(SEntryInfo) +
+		       index_size * sizeof(u16), GFP_KERNEL);
 	if (!*ent) {
-		kfree(*devs);
-		*devs = NULL;
-		return JSON_ERROR_NO_MEMORY;
+		ret = JSON_ERROR_NO_MEMORY;
+		goto free_devs;
 	}
-	(*ent)->i16uNumEntries = cnt;
-	cnt = 0;
-	find_entries(root_structure, *ent, &cnt, 0, 0, 1);
+	if (ld->ent)
+		memcpy(*ent, ld->ent, sizeof(piEntries) + cnt * sizeof(SEntryInfo));
+	(*ent)->i32uNameIndexMask = index_size - 1;
+	(*ent)->pi16uNameIndex = (u16 *) &(*ent)->ent[cnt];
+	build_name_index(*ent);
 
 	// copy the config value into the module driver
-	piDIOComm_InitStart();
-	piAIOComm_InitStart();
-	revpi_mio_reset();
-	revpi_ro_reset();
+	if (configure_modules) {
+		piDIOComm_InitStart();
+		piAIOComm_InitStart();
+		revpi_mio_reset();
+		revpi_ro_reset();
+	}
 
-	for (i = 0; i < (*devs)->i16uNumDevices; i++) {
+	for (i = 0; configure_modules && i < (*devs)->i16uNumDevices; i++) {
 		switch ((*devs)->dev[i].i16uModuleType) {
 		case KUNBUS_FW_DESCR_TYP_PI_DIO_14:
 		case KUNBUS_FW_DESCR_TYP_PI_DI_16:
@@ -827,20 +1059,19 @@ int piConfigParse(const char *filename, piDevices ** devs, piEntries ** ent, piC
 
 	}
 
-	*connl = find_connections(root_structure, *devs, *ent, NULL, 1);
+	*connl = resolve_connections(ld, *ent);
 
 	// Generate Copy List
-	*cl = kzalloc(sizeof(piCopylist) + exported_outputs * sizeof(piCopyEntry), GFP_KERNEL);
+	*cl = kzalloc(sizeof(piCopylist) +
+		      exported_outputs * (sizeof(piCopyEntry) + sizeof(piCopyRun)) +
+		      KB_PI_LEN, GFP_KERNEL);
 	if (!*cl) {
-		kfree(*connl);
-		*connl = NULL;
-		kfree(*ent);
-		*ent = NULL;
-		kfree(*devs);
-		*devs = NULL;
-		return JSON_ERROR_NO_MEMORY;
+		ret = JSON_ERROR_NO_MEMORY;
+		goto free_connl;
 	}
 	(*cl)->i16uNumEntries = exported_outputs;
+	(*cl)->pRuns = (piCopyRun *) &(*cl)->ent[exported_outputs];
+	(*cl)->pi8uMask = (u8 *) &(*cl)->pRuns[exported_outputs];
 	d = 0;
 	for (i = 0; i < (*ent)->i16uNumEntries && d <= exported_outputs; i++) {
 		if ((*ent)->ent[i].i8uType == 0x82) {
@@ -850,8 +1081,12 @@ int piConfigParse(const char *filename, piDevices ** devs, piEntries ** ent, piC
 				exported_outputs = 0;
 			} else {
 				(*cl)->ent[d].i16uAddr = (*ent)->ent[i].i16uOffset;
-				(*cl)->ent[d].i8uBitMask =
-				    (0xff >> (8 - (*ent)->ent[i].i16uBitLength)) << (*ent)->ent[i].i8uBitPos;
+				// outputs of 8 bits and more cover whole bytes
+				if ((*ent)->ent[i].i16uBitLength < 8)
+					(*cl)->ent[d].i8uBitMask =
+					    (0xff >> (8 - (*ent)->ent[i].i16uBitLength)) << (*ent)->ent[i].i8uBitPos;
+				else
+					(*cl)->ent[d].i8uBitMask = 0xff;
 				(*cl)->ent[d].i16uLength = (*ent)->ent[i].i16uBitLength;
 				d++;
 			}
@@ -901,11 +1136,352 @@ int piConfigParse(const char *filename, piDevices ** devs, piEntries ** ent, piC
 	}
 
 	(*cl)->i16uNumEntries = i;
+	build_copy_runs(*cl);
+
+	return 0;
+
+free_connl:
+	kfree(*connl);
+	*connl = NULL;
+	kfree(*ent);
+	*ent = NULL;
+free_devs:
+	kfree(*devs);
+	*devs = NULL;
+	return ret;
+}
+
+static char *picontrol_config_image = PICONFIG_IMAGE_FILE;
+module_param(picontrol_config_image, charp, S_IRUSR);
+MODULE_PARM_DESC(picontrol_config_image, "Precompiled configuration, used instead of "
+			 PICONFIG_FILE " if it is up to date. \"\" to disable.");
+
+/* Read a whole file into the arena, NULL if it cannot be read. */
+static void *read_file(const char *filename, size_t *size)
+{
+	size_t len = 0, buf_size = PAGE_SIZE;
+	struct file *input;
+	ssize_t read;
+	u8 *buf;
+
+	input = filp_open(filename, O_RDONLY, 0);
+	if (IS_ERR(input))
+		return NULL;
+
+	buf = config_alloc(buf_size);
+	while (buf) {
+		read = kernel_read(input, buf + len, buf_size - len, &input->f_pos);
+		if (read <= 0) {
+			if (read < 0)
+				buf = NULL;
+			break;
+		}
+		len += read;
+		if (len == buf_size) {
+			buf_size *= 2;
+			buf = config_realloc(buf, buf_size);
+		}
+	}
+	filp_close(input, NULL);
+
+	*size = len;
+	return buf;
+}
+
+static u32 image_crc(const void *data, size_t len)
+{
+	return ~crc32_le(~0, data, len);
+}
 
-	free_tree(root_structure);
+/*
+ * Check the entry ranges of the devices and the addresses of the connections
+ * of an image, build_config() and the I/O cycle use them without checks.
+ */
+static bool image_is_consistent(const struct config_loader *ld)
+{
+	const piConnection *conn;
+	const SDeviceInfo *dev;
+	unsigned int i, len;
+
+	for (i = 0; i < ld->devs->i16uNumDevices; i++) {
+		dev = &ld->devs->dev[i];
+		if (dev->i16uFirstEntry + dev->i16uEntries > ld->ent->i16uNumEntries)
+			return false;
+	}
+
+	// unresolved connections have length 0, they are skipped
+	for (i = 0; i < ld->connl->i16uNumEntries; i++) {
+		conn = &ld->connl->conn[i];
+		len = conn->i8uLength;
+		if (len >= 8) {
+			if (len % 8 || conn->i16uSrcAddr + len / 8 > KB_PI_LEN ||
+			    conn->i16uDestAddr + len / 8 > KB_PI_LEN)
+				return false;
+		} else if (len > 0) {
+			if (conn->i8uSrcBit >= 8 || conn->i8uDestBit >= 8 ||
+			    conn->i16uSrcAddr * 8 + conn->i8uSrcBit + len > KB_PI_LEN * 8 ||
+			    conn->i16uDestAddr * 8 + conn->i8uDestBit + len > KB_PI_LEN * 8)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Load the precompiled configuration instead of parsing filename. Fails if
+ * there is no image or if it was not compiled from the current content of
+ * filename.
+ */
+static int load_image(const char *filename, struct config_loader *ld)
+{
+	size_t size, src_size, devs_len, ent_len, conn_len;
+	const piConfigImageHeader *hdr;
+	const u8 *src, *p;
+	int i;
+
+	memset(ld, 0, sizeof(*ld));
+
+	if (!picontrol_config_image || !*picontrol_config_image)
+		return 1;
+
+	hdr = read_file(picontrol_config_image, &size);
+	if (!hdr)
+		goto failed;
+
+	if (size < sizeof(*hdr) || hdr->i32uMagic != PICONFIG_IMAGE_MAGIC
+	    || hdr->i16uVersion != PICONFIG_IMAGE_VERSION
+	    || hdr->i16uHeaderSize != sizeof(*hdr)
+	    || hdr->i16uDeviceSize != sizeof(SDeviceInfo)
+	    || hdr->i16uEntrySize != sizeof(SEntryInfo)
+	    || hdr->i16uConnectionSize != sizeof(piConnection)) {
+		pr_warn("%s has an unknown format, ignored\n", picontrol_config_image);
+		goto failed;
+	}
+
+	devs_len = hdr->i16uNumDevices * sizeof(SDeviceInfo);
+	ent_len = hdr->i16uNumEntries * sizeof(SEntryInfo);
+	conn_len = hdr->i16uNumConnections * sizeof(piConnection);
+	if (hdr->i32uSize != size
+	    || size != sizeof(*hdr) + devs_len + ent_len + conn_len
+	    || hdr->i32uCrc != image_crc(hdr + 1, size - sizeof(*hdr))) {
+		pr_warn("%s is damaged, ignored\n", picontrol_config_image);
+		goto failed;
+	}
+
+	src = read_file(filename, &src_size);
+	if (!src || hdr->i32uSourceSize != src_size
+	    || hdr->i32uSourceCrc != image_crc(src, src_size)) {
+		pr_info("%s is out of date, reading %s\n", picontrol_config_image, filename);
+		goto failed;
+	}
+	config_free((void *) src);
+
+	ld->devs = config_alloc(sizeof(piDevices) + devs_len);
+	ld->ent = config_calloc(1, sizeof(piEntries) + ent_len);
+	ld->connl = config_alloc(sizeof(piConnectionList) + conn_len);
+	if (!ld->devs || !ld->ent || !ld->connl)
+		goto failed;
+
+	p = (const u8 *) (hdr + 1);
+	ld->devs->i16uNumDevices = hdr->i16uNumDevices;
+	memcpy(ld->devs->dev, p, devs_len);
+	p += devs_len;
+	ld->ent->i16uNumEntries = hdr->i16uNumEntries;
+	memcpy(ld->ent->ent, p, ent_len);
+	p += ent_len;
+	ld->connl->i16uNumEntries = hdr->i16uNumConnections;
+	memcpy(ld->connl->conn, p, conn_len);
+	ld->conn_found = hdr->i16uFlags & PICONFIG_IMAGE_CONNECTIONS;
+
+	if (!image_is_consistent(ld)) {
+		pr_warn("%s is damaged, ignored\n", picontrol_config_image);
+		goto failed;
+	}
+
+	// the names are used for the hash index
+	for (i = 0; i < ld->ent->i16uNumEntries; i++)
+		ld->ent->ent[i].strVarName[sizeof(ld->ent->ent[i].strVarName) - 1] = 0;
+
+	pr_info("using precompiled configuration %s\n", picontrol_config_image);
+	return 0;
+
+failed:
+	// start over with an empty arena for the configuration file
+	config_arena_release();
+	memset(ld, 0, sizeof(*ld));
+	return 1;
+}
 
+/*
+ * Parse the configuration file, or load its precompiled image if there is
+ * an up to date one. See build_config() for configure_modules.
+ */
+int piConfigParse(const char *filename, piDevices ** devs, piEntries ** ent, piCopylist ** cl,
+		  piConnectionList ** connl, bool configure_modules)
+{
+	struct config_loader ld;
+	int ret;
+
+	*devs = NULL;
+	*ent = NULL;
+	*cl = NULL;
+	*connl = NULL;
+
+	ret = load_image(filename, &ld);
+	if (ret)
+		ret = load_config(filename, &ld);
+	if (!ret)
+		ret = build_config(&ld, devs, ent, cl, connl, configure_modules);
+
+	config_arena_release();
+	return ret;
+}
+
+#ifndef __KERNEL__
+/*
+ * Compile the configuration file into an image for piConfigParse(). The
+ * image is allocated with kvmalloc(). Only built for tools/piconfig.
+ */
+int piConfigCompile(const char *filename, void **image, size_t *size)
+{
+	size_t src_size, devs_len, ent_len, conn_len;
+	piConnectionList *connl = NULL;
+	piCopylist *cl = NULL;
+	piEntries *ent = NULL;
+	piDevices *devs = NULL;
+	piConfigImageHeader *hdr;
+	struct config_loader ld;
+	u32 src_crc;
+	void *src;
+	u8 *p;
+	int ret;
+
+	*image = NULL;
+
+	src = read_file(filename, &src_size);
+	if (!src || src_size > U32_MAX) {
+		pr_err("error: cannot read file %s\n", filename);
+		ret = 2;
+		goto release_arena;
+	}
+	src_crc = image_crc(src, src_size);
+	config_free(src);
+
+	ret = load_config(filename, &ld);
+	if (!ret)
+		ret = build_config(&ld, &devs, &ent, &cl, &connl, false);
+	if (ret)
+		goto release_arena;
+
+	devs_len = ld.devs->i16uNumDevices * sizeof(SDeviceInfo);
+	ent_len = ent->i16uNumEntries * sizeof(SEntryInfo);
+	conn_len = connl ? connl->i16uNumEntries * sizeof(piConnection) : 0;
+	*size = sizeof(*hdr) + devs_len + ent_len + conn_len;
+
+	hdr = kvzalloc(*size, GFP_KERNEL);
+	if (!hdr) {
+		ret = JSON_ERROR_NO_MEMORY;
+		goto free_config;
+	}
+	hdr->i32uMagic = PICONFIG_IMAGE_MAGIC;
+	hdr->i16uVersion = PICONFIG_IMAGE_VERSION;
+	hdr->i16uHeaderSize = sizeof(*hdr);
+	hdr->i32uSize = *size;
+	hdr->i32uSourceSize = src_size;
+	hdr->i32uSourceCrc = src_crc;
+	hdr->i16uFlags = connl ? PICONFIG_IMAGE_CONNECTIONS : 0;
+	hdr->i16uNumDevices = ld.devs->i16uNumDevices;
+	hdr->i16uNumEntries = ent->i16uNumEntries;
+	hdr->i16uNumConnections = connl ? connl->i16uNumEntries : 0;
+	hdr->i16uDeviceSize = sizeof(SDeviceInfo);
+	hdr->i16uEntrySize = sizeof(SEntryInfo);
+	hdr->i16uConnectionSize = sizeof(piConnection);
+
+	// the devices and entries before build_config() adjusted them
+	p = (u8 *) (hdr + 1);
+	memcpy(p, ld.devs->dev, devs_len);
+	p += devs_len;
+	if (ent_len)
+		memcpy(p, ld.ent->ent, ent_len);
+	p += ent_len;
+	if (conn_len)
+		memcpy(p, connl->conn, conn_len);
+	hdr->i32uCrc = image_crc(hdr + 1, *size - sizeof(*hdr));
+	*image = hdr;
+
+free_config:
+	kfree(connl);
+	kfree(cl);
+	kfree(ent);
+	kfree(devs);
+release_arena:
+	config_arena_release();
 	return ret;
 }
+#endif /* !__KERNEL__ */
+
+/*
+ * Check if the configuration new_devs/new_ent can replace devs/ent while the
+ * I/O communication keeps running. The modules and their position in the
+ * process image must be the same and the variables of the modules, which are
+ * passed to the module drivers, may only differ in their names. Variables of
+ * virtual modules may change as long as the module keeps its size.
+ */
+bool piConfigSameLayout(const piDevices *devs, const piEntries *ent,
+			const piDevices *new_devs, const piEntries *new_ent)
+{
+	const SDeviceInfo *a, *b;
+	const SEntryInfo *ea, *eb;
+	int i, j;
+
+	if (devs->i16uNumDevices != new_devs->i16uNumDevices)
+		return false;
+
+	for (i = 0; i < devs->i16uNumDevices; i++) {
+		a = &devs->dev[i];
+		b = &new_devs->dev[i];
+
+		if (a->i8uAddress != b->i8uAddress
+		    || a->i16uModuleType != b->i16uModuleType
+		    || a->i32uSerialnumber != b->i32uSerialnumber
+		    || a->i16uHW_Revision != b->i16uHW_Revision
+		    || a->i16uSW_Major != b->i16uSW_Major
+		    || a->i16uSW_Minor != b->i16uSW_Minor
+		    || a->i32uSVN_Revision != b->i32uSVN_Revision
+		    || a->i16uBaseOffset != b->i16uBaseOffset
+		    || a->i16uInputOffset != b->i16uInputOffset
+		    || a->i16uInputLength != b->i16uInputLength
+		    || a->i16uOutputOffset != b->i16uOutputOffset
+		    || a->i16uOutputLength != b->i16uOutputLength
+		    || a->i16uConfigOffset != b->i16uConfigOffset
+		    || a->i16uConfigLength != b->i16uConfigLength
+		    || a->i8uCycleDivider != b->i8uCycleDivider)
+			return false;
+
+		if (a->i16uModuleType >= PICONTROL_SW_OFFSET)
+			continue;
+
+		if (a->i16uEntries != b->i16uEntries)
+			return false;
+
+		for (j = 0; j < a->i16uEntries; j++) {
+			ea = &ent->ent[a->i16uFirstEntry + j];
+			eb = &new_ent->ent[b->i16uFirstEntry + j];
+
+			/* the export flag may change */
+			if ((ea->i8uType ^ eb->i8uType) & ENTRY_INFO_TYPE_MASK
+			    || ea->i16uIndex != eb->i16uIndex
+			    || ea->i16uBitLength != eb->i16uBitLength
+			    || ea->i8uBitPos != eb->i8uBitPos
+			    || ea->i16uOffset != eb->i16uOffset
+			    || ea->i32uDefault != eb->i32uDefault)
+				return false;
+		}
+	}
+
+	return true;
+}
 
 void revpi_set_defaults(unsigned char *mem, piEntries *entries)
 {
@@ -979,3 +1555,138 @@ void revpi_set_defaults(unsigned char *mem, piEntries *entries)
 		}
 	}
 }
+
+/*
+ * The connections of the configuration are compiled into a list of copy
+ * operations: byte runs for connections of 8, 16 or 32 bits and masked
+ * bit moves for shorter ones. Bit moves with the same source and
+ * destination byte and the same shift are merged into one operation, as
+ * are byte runs which are adjacent in the source and the destination.
+ */
+static void add_bit_move(piConnectionOp *op, unsigned int src,
+			 unsigned int dest)
+{
+	op->i16uSrcAddr = src / 8;
+	op->i16uDestAddr = dest / 8;
+	op->i16uLength = 0;
+	op->i8sShift = (int) (dest % 8) - (int) (src % 8);
+	op->i8uMask = 1 << (dest % 8);
+}
+
+static int cmp_connection_op(const void *a, const void *b)
+{
+	const piConnectionOp *x = a, *y = b;
+
+	/* byte runs first, then bit moves */
+	if (!x->i16uLength != !y->i16uLength)
+		return x->i16uLength ? -1 : 1;
+	if (x->i16uDestAddr != y->i16uDestAddr)
+		return x->i16uDestAddr - y->i16uDestAddr;
+	if (x->i16uSrcAddr != y->i16uSrcAddr)
+		return x->i16uSrcAddr - y->i16uSrcAddr;
+	return x->i8sShift - y->i8sShift;
+}
+
+piConnectionProgram *piConfigCompileConnections(const piConnectionList *connl)
+{
+	piConnectionProgram *prog;
+	piConnectionOp *op;
+	unsigned int max_ops = 0;
+	unsigned int i, j, n = 0;
+
+	if (!connl)
+		return NULL;
+
+	/* each bit of a short connection may need an operation of its own */
+	for (i = 0; i < connl->i16uNumEntries; i++)
+		max_ops += connl->conn[i].i8uLength < 8 ?
+			   connl->conn[i].i8uLength : 1;
+
+	prog = kvzalloc(struct_size(prog, op, max_ops), GFP_KERNEL);
+	if (!prog)
+		return NULL;
+
+	for (i = 0; i < connl->i16uNumEntries; i++) {
+		const piConnection *conn = &connl->conn[i];
+		unsigned int len = conn->i8uLength;
+
+		if (len >= 8) {
+			if (len % 8 || conn->i16uSrcAddr + len / 8 > KB_PI_LEN ||
+			    conn->i16uDestAddr + len / 8 > KB_PI_LEN) {
+				pr_err("error: invalid connection %u\n", i + 1);
+				continue;
+			}
+			op = &prog->op[n++];
+			op->i16uSrcAddr = conn->i16uSrcAddr;
+			op->i16uDestAddr = conn->i16uDestAddr;
+			op->i16uLength = len / 8;
+		} else if (len > 0) {
+			unsigned int src = conn->i16uSrcAddr * 8 + conn->i8uSrcBit;
+			unsigned int dest = conn->i16uDestAddr * 8 + conn->i8uDestBit;
+
+			if (src + len > KB_PI_LEN * 8 ||
+			    dest + len > KB_PI_LEN * 8) {
+				pr_err("error: invalid connection %u\n", i + 1);
+				continue;
+			}
+			for (j = 0; j < len; j++)
+				add_bit_move(&prog->op[n++], src + j, dest + j);
+		}
+	}
+
+	sort(prog->op, n, sizeof(*op), cmp_connection_op, NULL);
+
+	prog->i32uNumOps = 0;
+	for (i = 0; i < n; i++) {
+		piConnectionOp *cur = &prog->op[i];
+
+		op = prog->i32uNumOps ? &prog->op[prog->i32uNumOps - 1] : NULL;
+		if (op && op->i16uLength && cur->i16uLength &&
+		    op->i16uSrcAddr + op->i16uLength == cur->i16uSrcAddr &&
+		    op->i16uDestAddr + op->i16uLength == cur->i16uDestAddr) {
+			op->i16uLength += cur->i16uLength;
+		} else if (op && !op->i16uLength && !cur->i16uLength &&
+			   op->i16uSrcAddr == cur->i16uSrcAddr &&
+			   op->i16uDestAddr == cur->i16uDestAddr &&
+			   op->i8sShift == cur->i8sShift) {
+			op->i8uMask |= cur->i8uMask;
+		} else {
+			prog->op[prog->i32uNumOps++] = *cur;
+		}
+	}
+
+	pr_debug("%d connections compiled to %u copy operations\n",
+		 connl->i16uNumEntries, prog->i32uNumOps);
+
+	if (!prog->i32uNumOps) {
+		kvfree(prog);
+		return NULL;
+	}
+
+	return prog;
+}
+
+void piConfigRunConnections(const piConnectionProgram *prog, u8 *mem)
+{
+	const piConnectionOp *op;
+	int i;
+	u8 val;
+
+	for (i = 0; i < prog->i32uNumOps; i++) {
+		op = &prog->op[i];
+
+		if (op->i16uLength) {
+			memmove(mem + op->i16uDestAddr, mem + op->i16uSrcAddr,
+				op->i16uLength);
+			continue;
+		}
+
+		val = mem[op->i16uSrcAddr];
+		if (op->i8sShift >= 0)
+			val <<= op->i8sShift;
+		else
+			val >>= -op->i8sShift;
+		mem[op->i16uDestAddr] = (mem[op->i16uDestAddr] & ~op->i8uMask) |
+					(val & op->i8uMask);
+	}
+}
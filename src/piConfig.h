@@ -10,8 +10,13 @@
 #include "json.h"
 #include "picontrol_intern.h"
 
+struct dentry;
+
 typedef struct _piEntries {
 	uint16_t i16uNumEntries;
+	// hash index over strVarName, allocated behind ent[], see piConfigFindEntry()
+	uint32_t i32uNameIndexMask;
+	uint16_t *pi16uNameIndex;
 	SEntryInfo ent[0];
 } piEntries;
 
@@ -26,8 +31,22 @@ typedef struct _piCopyEntry {
 	uint8_t i8uBitMask;	// bitmask for bits to copy
 } piCopyEntry;
 
+// run of contiguous bytes with exported outputs, compiled from piCopyEntry
+typedef struct _piCopyRun {
+	uint16_t i16uAddr;
+	uint16_t i16uLength;	// in bytes
+	uint16_t i16uMaskOffset;	// offset of the byte masks in pi8uMask
+	uint8_t i8uFull;	// all bits of all bytes are exported
+} piCopyRun;
+
 typedef struct _piCopylist {
 	uint16_t i16uNumEntries;
+	// runs and masks, allocated behind ent[], see piCopylistMerge()
+	uint16_t i16uNumRuns;
+	uint16_t i16uSpanAddr;	// first byte of the first run
+	uint16_t i16uSpanLength;	// up to the last byte of the last run
+	piCopyRun *pRuns;
+	uint8_t *pi8uMask;
 	piCopyEntry ent[0];
 } piCopylist;
 
@@ -44,12 +63,66 @@ typedef struct _piConnectionlist {
 	piConnection conn[0];
 } piConnectionList;
 
+// copy operation compiled from the connections, see piConfigCompileConnections()
+typedef struct _piConnectionOp {
+	uint16_t i16uSrcAddr;
+	uint16_t i16uDestAddr;
+	uint16_t i16uLength;	// number of bytes to copy, 0 for a bit move
+	int8_t i8sShift;	// bit move: shift from source to destination bits
+	uint8_t i8uMask;	// bit move: bits of the destination byte to set
+} piConnectionOp;
+
+typedef struct _piConnectionProgram {
+	uint32_t i32uNumOps;
+	piConnectionOp op[0];
+} piConnectionProgram;
+
+/*
+ * Precompiled configuration, see piConfigCompile(). The header is followed
+ * by the devices and the entries as they are read from config.rsc, i.e.
+ * before the offsets are adjusted, and by the resolved connections. All
+ * values are in the byte order of the machine that compiled the image.
+ */
+#define PICONFIG_IMAGE_MAGIC		0x46435052	// "RPCF"
+#define PICONFIG_IMAGE_VERSION		1
+#define PICONFIG_IMAGE_CONNECTIONS	0x0001	// configuration has "Connections"
+
+typedef struct _piConfigImageHeader {
+	uint32_t i32uMagic;
+	uint16_t i16uVersion;
+	uint16_t i16uHeaderSize;
+	uint32_t i32uSize;	// of the whole image
+	uint32_t i32uCrc;	// crc32 of everything behind the header
+	uint32_t i32uSourceSize;	// size of the config.rsc it was compiled from
+	uint32_t i32uSourceCrc;	// crc32 of that config.rsc
+	uint16_t i16uFlags;
+	uint16_t i16uNumDevices;
+	uint16_t i16uNumEntries;
+	uint16_t i16uNumConnections;
+	uint16_t i16uDeviceSize;	// sizeof(SDeviceInfo)
+	uint16_t i16uEntrySize;	// sizeof(SEntryInfo)
+	uint16_t i16uConnectionSize;	// sizeof(piConnection)
+	uint16_t i16uReserved;
+} piConfigImageHeader;
+
 int piConfigParse(const char *filename, piDevices ** devs, piEntries ** ent, piCopylist ** cl,
-		  piConnectionList ** conn);
+		  piConnectionList ** conn, bool configure_modules);
+#ifndef __KERNEL__
+int piConfigCompile(const char *filename, void **image, size_t *size);
+#endif
+bool piConfigSameLayout(const piDevices *devs, const piEntries *ent,
+			const piDevices *new_devs, const piEntries *new_ent);
+
+void piConfigDebugfsInit(struct dentry *parent);
 
 struct file *open_filename(const char *filename, int flags);
 void close_filename(struct file *file);
 void revpi_set_defaults(unsigned char *mem, piEntries *entries);
+SEntryInfo *piConfigFindEntry(piEntries *entries, const char *name);
+void piCopylistMerge(const piCopylist *cl, u8 *mem, const u8 *src);
+void piCopylistClear(const piCopylist *cl, u8 *mem);
+piConnectionProgram *piConfigCompileConnections(const piConnectionList *connl);
+void piConfigRunConnections(const piConnectionProgram *prog, u8 *mem);
 int process_file(json_parser * parser, struct file *input, int *retlines, int *retcols);
 
 #endif
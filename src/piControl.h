@@ -87,8 +87,10 @@ typedef struct SDeviceInfoStr {
 	__u8 i8uModuleState;
 	/* 0 means that the module is not present and no data is available */
 	__u8 i8uActive;
+	/* the module is serviced every i8uCycleDivider-th cycle, 0 or 1: every cycle */
+	__u8 i8uCycleDivider;
 	/* space for future extensions */
-	__u8 i8uReserve[30];		
+	__u8 i8uReserve[29];		
 } SDeviceInfo;
 
 typedef struct SPIValueStr {
@@ -100,6 +102,30 @@ typedef struct SPIValueStr {
 	__u8 i8uValue;
 } SPIValue;
 
+struct picontrol_value {
+	/* Address of the first byte in the process image */
+	__u16 addr;
+	/* 0-7 bit position, only used if width is 1 */
+	__u8 bit;
+	/* width of the value in bits, possible values are 1, 8, 16 and 32 */
+	__u8 width;
+	/* value, stored in little endian byte order in the process image */
+	__u32 value;
+	/* 0 on success or a negative error number, set by the driver */
+	__s32 status;
+};
+
+/* Data for KB_GET_VALUES and KB_SET_VALUES ioctls */
+struct picontrol_values {
+	/* number of elements in values, max. PICONTROL_VALUES_MAX */
+	__u32 count;
+	__u32 pad;
+	/* pointer to an array of struct picontrol_value */
+	__u64 values;
+};
+
+#define PICONTROL_VALUES_MAX			4096
+
 typedef struct SPIVariableStr {
 	/* Variable name */
 	char strVarName[32];
@@ -112,6 +138,17 @@ typedef struct SPIVariableStr {
 	__u16 i16uLength;		
 } SPIVariable;
 
+/* Data for KB_FIND_VARIABLES ioctl */
+struct picontrol_variables {
+	/* number of elements in variables, max. PICONTROL_VARIABLES_MAX */
+	__u32 count;
+	__u32 pad;
+	/* pointer to an array of SPIVariable */
+	__u64 variables;
+};
+
+#define PICONTROL_VARIABLES_MAX			4096
+
 #define KB_IOC_MAGIC  'K'
 /* reset the piControl driver including the config file */
 #define  KB_RESET				_IO(KB_IOC_MAGIC, 12 )
@@ -147,20 +184,166 @@ typedef struct SPIVariableStr {
  * are set to 0.
  */
 #define  KB_SET_OUTPUT_WATCHDOG			_IO(KB_IOC_MAGIC, 26 )
+/* or'ed to the period of KB_SET_OUTPUT_WATCHDOG: on timeout set only the
+ * outputs to 0 which were written with the file handle
+ */
+#define  PICONTROL_WATCHDOG_OWN_OUTPUTS		0x80000000
 /* set the f_pos, the unsigned int * is used to interpret the pos value */
 #define  KB_SET_POS				_IO(KB_IOC_MAGIC, 27 )
 #define  KB_AIO_CALIBRATE			_IO(KB_IOC_MAGIC, 28 )
 /* get counter values of a RO module */
 #define  KB_RO_GET_COUNTER			_IO(KB_IOC_MAGIC, 29 )
+/* get/set several values of the process image with one call,
+ * struct picontrol_values * is used as argument
+ */
+#define  KB_GET_VALUES				_IO(KB_IOC_MAGIC, 30 )
+#define  KB_SET_VALUES				_IO(KB_IOC_MAGIC, 31 )
+/* find several variables with one call, struct picontrol_variables * is used
+ * as argument
+ */
+#define  KB_FIND_VARIABLES			_IO(KB_IOC_MAGIC, 32 )
+/* set the ranges of the process image to watch for changes,
+ * struct picontrol_watches * is used as argument
+ */
+#define  KB_SET_WATCHES				_IO(KB_IOC_MAGIC, 33 )
+/* get and clear the changes of the watched ranges,
+ * struct picontrol_changes * is used as argument
+ */
+#define  KB_GET_CHANGES				_IO(KB_IOC_MAGIC, 34 )
 
 /* wait for an event. This call is normally blocking */
 #define  KB_WAIT_FOR_EVENT			_IO(KB_IOC_MAGIC, 50 )
 /* piControl was reset, reload configuration */
 #define  KB_EVENT_RESET				1
+/* a cycle took longer than the cycle duration, arg: number of missed cycles */
+#define  KB_EVENT_CYCLE_OVERRUN			2
+/* a module stopped responding, arg: address of the module */
+#define  KB_EVENT_MODULE_OFFLINE		3
+/* a module responds again, arg: address of the module */
+#define  KB_EVENT_MODULE_ONLINE			4
+/* the configuration was loaded, sent to all file handles */
+#define  KB_EVENT_CONFIG_RELOADED		5
+/* wait for the end of the next I/O cycle, struct picontrol_cycle_info * is
+ * optional
+ */
+#define  PICONTROL_WAIT_FOR_CYCLE		_IO(KB_IOC_MAGIC, 51 )
+/* collect the outputs written with this file handle until
+ * PICONTROL_COMMIT_OUTPUTS, blocks until a previous commit was applied
+ */
+#define  PICONTROL_BEGIN_OUTPUTS		_IO(KB_IOC_MAGIC, 52 )
+/* apply the collected outputs at the start of the next I/O cycle */
+#define  PICONTROL_COMMIT_OUTPUTS		_IO(KB_IOC_MAGIC, 53 )
+/* get several events with one call, struct picontrol_events * is used as
+ * argument. Blocks until an event is available unless O_NONBLOCK is set.
+ */
+#define  PICONTROL_GET_EVENTS			_IO(KB_IOC_MAGIC, 54 )
+/* load the configuration file again. If the modules and their offsets did
+ * not change, the I/O communication keeps running, otherwise like KB_RESET.
+ */
+#define  PICONTROL_RELOAD_CONFIG			_IO(KB_IOC_MAGIC, 55 )
 
 /* new ioctl to upload firmware */
 #define PICONTROL_UPLOAD_FIRMWARE		_IOW(KB_IOC_MAGIC, 200, struct picontrol_firmware_upload )
 
+/*
+ * Layout of the memory that can be mapped with mmap() on PICONTROL_DEVICE.
+ * The offsets are given in pages, i.e. they have to be multiplied with the
+ * page size of the system (sysconf(_SC_PAGESIZE)) before passing them to
+ * mmap().
+ */
+/* the process image, may be mapped read-only or read-write */
+#define PICONTROL_MMAP_PGOFF_IMAGE		0
+/* struct picontrol_mmap_status, may only be mapped read-only */
+#define PICONTROL_MMAP_PGOFF_STATUS		1
+/*
+ * Two read-only copies of the process image, one page each, published by
+ * the driver at the end of every I/O cycle (see published_seq)
+ */
+#define PICONTROL_MMAP_PGOFF_PUBLISHED		2
+
+struct picontrol_mmap_status {
+	/*
+	 * Incremented by the driver before and after it writes input data
+	 * into the process image. The value is odd while an update is in
+	 * progress. A consistent copy of the inputs has been read if the
+	 * value was even before reading and unchanged afterwards.
+	 */
+	__u32 seq;
+	/*
+	 * Incremented by the driver before each update of one of the
+	 * published copies of the process image. The copy in page
+	 * (published_seq & 1) is stable. A consistent snapshot of the whole
+	 * process image has been read if the value is unchanged afterwards.
+	 */
+	__u32 published_seq;
+	/* Memory is cheap, so reserve a few bytes for future extensions */
+	__u32 reserved[14];
+};
+
+struct picontrol_watch {
+	/* first byte of the range in the process image */
+	__u16 addr;
+	/* number of bytes in the range */
+	__u16 len;
+	/* bits to watch in each byte of the range */
+	__u8 mask;
+	__u8 pad[3];
+};
+
+/* Data for KB_SET_WATCHES ioctl */
+struct picontrol_watches {
+	/* number of elements in watches, max. PICONTROL_WATCHES_MAX */
+	__u32 count;
+	__u32 pad;
+	/* pointer to an array of struct picontrol_watch */
+	__u64 watches;
+};
+
+#define PICONTROL_WATCHES_MAX			64
+
+/* Data for KB_GET_CHANGES ioctl */
+struct picontrol_changes {
+	/* bit n is set if watch n has changed */
+	__u64 changed;
+	/* first and last cycle in which a change was detected */
+	__u64 first_cycle;
+	__u64 last_cycle;
+};
+
+/* Event returned by PICONTROL_GET_EVENTS */
+struct picontrol_event {
+	/* KB_EVENT_* */
+	__u32 type;
+	/* depends on type, e.g. address of the module */
+	__u32 arg;
+	/* number of the last completed cycle when the event occurred */
+	__u64 cycle;
+	/* time of the event in nsecs (CLOCK_MONOTONIC) */
+	__u64 timestamp;
+};
+
+/* Data for PICONTROL_GET_EVENTS ioctl */
+struct picontrol_events {
+	/* in: number of elements in events, out: number of events returned */
+	__u32 count;
+	/* out: number of events lost since the last call, because the queue
+	 * of the file handle was full
+	 */
+	__u32 lost;
+	/* pointer to an array of struct picontrol_event */
+	__u64 events;
+};
+
+/* Data for PICONTROL_WAIT_FOR_CYCLE ioctl */
+struct picontrol_cycle_info {
+	/* number of the completed cycle */
+	__u64 cycle;
+	/* end of the cycle in nsecs (CLOCK_MONOTONIC) */
+	__u64 timestamp;
+	/* Memory is cheap, so reserve a few bytes for future extensions */
+	__u8 reserved[16];
+};
+
 typedef struct SDIOResetCounterStr {
 	/* Address of module in current configuration */
 	__u8 i8uAddress;
@@ -7,10 +7,14 @@
 //#define DEBUG
 
 
+#include <linux/debugfs.h>
 #include <linux/fs.h>
 #include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/poll.h>
 #include <linux/semaphore.h>
 #include <linux/thermal.h>
+#include <linux/uio.h>
 #include <linux/version.h>
 #include <linux/wait.h>
 #include <linux/firmware.h>
@@ -63,9 +67,11 @@ MODULE_PARM_DESC(picontrol_cycle_duration, "Specify a fixed io-cycle duration in
 
 static int piControlOpen(struct inode *inode, struct file *file);
 static int piControlRelease(struct inode *inode, struct file *file);
-static ssize_t piControlRead(struct file *file, char __user * pBuf, size_t count, loff_t * ppos);
-static ssize_t piControlWrite(struct file *file, const char __user * pBuf, size_t count, loff_t * ppos);
+static ssize_t piControlReadIter(struct kiocb *iocb, struct iov_iter *to);
+static ssize_t piControlWriteIter(struct kiocb *iocb, struct iov_iter *from);
 static loff_t piControlSeek(struct file *file, loff_t off, int whence);
+static int piControlMmap(struct file *file, struct vm_area_struct *vma);
+static __poll_t piControlPoll(struct file *file, poll_table *wait);
 static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long usr_addr);
 
 /******************************************************************************/
@@ -74,9 +80,11 @@ static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long
 
 static struct file_operations piControlFops = {
 owner:	THIS_MODULE,
-read:	piControlRead,
-write:	piControlWrite,
+read_iter:piControlReadIter,
+write_iter:piControlWriteIter,
 llseek:piControlSeek,
+mmap:	piControlMmap,
+poll:	piControlPoll,
 open:	piControlOpen,
 unlocked_ioctl:piControlIoctl,
 release:piControlRelease
@@ -146,6 +154,312 @@ unsigned int piControl_get_cycle_duration(void)
 	return duration;
 }
 
+/*
+ * Copy a range of the process image to both published copies. The copies are
+ * updated one after the other, so that readers always find a stable one
+ * without taking lockPI (see picontrol_published_begin()). Must be called
+ * with lockPI held.
+ */
+void picontrol_publish_image(unsigned int offset, unsigned int len)
+{
+	struct picontrol_mmap_status *status = piDev_g.mmap_status;
+	u8 *pub = piDev_g.pi_published;
+
+	/*
+	 * readers use copy 1 while copy 0 is updated and vice versa. Like in
+	 * raw_write_seqcount_latch(), the copy to page 1 of the last call must
+	 * be visible before readers are sent to it.
+	 */
+	smp_wmb();
+	WRITE_ONCE(status->published_seq, status->published_seq + 1);
+	smp_wmb();
+	memcpy(pub + offset, piDev_g.ai8uPI + offset, len);
+	smp_wmb();
+	WRITE_ONCE(status->published_seq, status->published_seq + 1);
+	smp_wmb();
+	memcpy(pub + PAGE_SIZE + offset, piDev_g.ai8uPI + offset, len);
+}
+
+/* Publish the whole process image at the end of an I/O cycle. */
+void picontrol_publish_cycle(void)
+{
+	my_rt_mutex_lock(&piDev_g.lockPI);
+	picontrol_publish_image(0, KB_PI_LEN);
+	rt_mutex_unlock(&piDev_g.lockPI);
+}
+
+/*
+ * Copy inputs to outputs as defined by the connections in the configuration.
+ * Called by the I/O threads with lockPI held, after the inputs of a cycle
+ * were written to the process image and before the outputs are sent.
+ */
+void picontrol_run_connections(void)
+{
+	if (!piDev_g.connp)
+		return;
+
+	picontrol_image_write_begin();
+	piConfigRunConnections(piDev_g.connp, piDev_g.ai8uPI);
+	picontrol_image_write_end();
+}
+
+static void picontrol_apply_staging(tpiControlInst *priv)
+{
+	struct picontrol_staging *st = priv->staging;
+	u8 *pi = piDev_g.ai8uPI;
+	unsigned int i;
+
+	if (st->start >= st->end)
+		return;
+
+	for (i = st->start; i < st->end; i++)
+		pi[i] = (pi[i] & ~st->mask[i]) | (st->data[i] & st->mask[i]);
+
+	if (priv->wd_owned) {
+		for (i = st->start; i < st->end; i++)
+			priv->wd_owned[i] |= st->mask[i];
+	}
+
+	memset(st->mask + st->start, 0, st->end - st->start);
+	st->start = KB_PI_LEN;
+	st->end = 0;
+}
+
+/*
+ * Apply the outputs committed with PICONTROL_COMMIT_OUTPUTS. Called by the
+ * I/O threads with lockPI held at the start of a cycle, before any outputs
+ * are sent, so that a transaction never spans two cycles.
+ */
+void picontrol_apply_outputs(void)
+{
+	tpiControlInst *priv, *tmp;
+
+	list_for_each_entry_safe(priv, tmp, &piDev_g.listCommit, commit_list) {
+		picontrol_apply_staging(priv);
+		list_del_init(&priv->commit_list);
+		wake_up_interruptible(&priv->wq);
+	}
+}
+
+/* Compare the watched ranges with their last seen content. */
+static void picontrol_check_watches(tpiControlInst *priv, u64 cycle)
+{
+	struct picontrol_changes *changes = &priv->changes;
+	u8 *shadow = priv->watch_shadow;
+	u64 changed = 0;
+	int i, j;
+
+	for (i = 0; i < priv->num_watches; i++) {
+		struct picontrol_watch *watch = &priv->watches[i];
+		u8 *pi = piDev_g.ai8uPI + watch->addr;
+
+		for (j = 0; j < watch->len; j++) {
+			if ((pi[j] ^ shadow[j]) & watch->mask)
+				changed |= BIT_ULL(i);
+			shadow[j] = pi[j];
+		}
+		shadow += watch->len;
+	}
+
+	if (!changed)
+		return;
+
+	if (!changes->changed)
+		changes->first_cycle = cycle;
+	changes->last_cycle = cycle;
+	changes->changed |= changed;
+
+	wake_up_interruptible(&priv->wq);
+}
+
+/* Called by the I/O threads at the end of every cycle. */
+void picontrol_cycle_completed(void)
+{
+	struct picontrol_cycle *cycle = &piDev_g.cycle;
+	tpiControlInst *priv;
+	u64 count;
+
+	write_seqlock(&cycle->lock);
+	count = ++cycle->count;
+	cycle->end = ktime_get();
+	write_sequnlock(&cycle->lock);
+
+	if (!list_empty(&piDev_g.listWatch)) {
+		my_rt_mutex_lock(&piDev_g.lockPI);
+		my_rt_mutex_lock(&piDev_g.lockWatch);
+		list_for_each_entry(priv, &piDev_g.listWatch, watch_list)
+			picontrol_check_watches(priv, count);
+		rt_mutex_unlock(&piDev_g.lockWatch);
+		rt_mutex_unlock(&piDev_g.lockPI);
+	}
+
+	wake_up_interruptible(&cycle->wq);
+}
+
+static unsigned int picontrol_cycle_hist_bucket(unsigned int usecs)
+{
+	unsigned int e;
+
+	if (usecs < PICONTROL_CYCLE_HIST_LINEAR)
+		return usecs;
+	if (usecs >= (1U << PICONTROL_CYCLE_HIST_MAX_BITS))
+		return PICONTROL_CYCLE_HIST_BUCKETS - 1;
+
+	e = fls(usecs) - 1;
+	return PICONTROL_CYCLE_HIST_LINEAR +
+	       (e - PICONTROL_CYCLE_HIST_SUB_BITS - 1) * PICONTROL_CYCLE_HIST_SUB +
+	       ((usecs >> (e - PICONTROL_CYCLE_HIST_SUB_BITS)) &
+		(PICONTROL_CYCLE_HIST_SUB - 1));
+}
+
+/* Return the smallest cycle time counted in bucket idx. */
+static unsigned int picontrol_cycle_hist_lower(unsigned int idx)
+{
+	unsigned int k, shift;
+
+	if (idx < PICONTROL_CYCLE_HIST_LINEAR)
+		return idx;
+
+	k = idx - PICONTROL_CYCLE_HIST_LINEAR;
+	shift = k / PICONTROL_CYCLE_HIST_SUB + 1;
+	return (PICONTROL_CYCLE_HIST_SUB + k % PICONTROL_CYCLE_HIST_SUB) << shift;
+}
+
+/*
+ * Count the duration of a completed cycle in the cycle histogram. Called by
+ * the I/O thread only, readers and the reset in sysfs do not block it.
+ */
+void picontrol_cycle_account(unsigned int usecs)
+{
+	atomic64_inc(&piDev_g.cycle.hist[picontrol_cycle_hist_bucket(usecs)]);
+}
+
+/* Return the number of completed cycles, fill info if not NULL. */
+static u64 picontrol_get_cycle(struct picontrol_cycle_info *info)
+{
+	struct picontrol_cycle *cycle = &piDev_g.cycle;
+	unsigned int seq;
+	ktime_t end;
+	u64 count;
+
+	do {
+		seq = read_seqbegin(&cycle->lock);
+		count = cycle->count;
+		end = cycle->end;
+	} while (read_seqretry(&cycle->lock, seq));
+
+	if (info) {
+		memset(info, 0, sizeof(*info));
+		info->cycle = count;
+		info->timestamp = ktime_to_ns(end);
+	}
+
+	return count;
+}
+
+static void picontrol_event_ring_init(struct picontrol_event_ring *ring)
+{
+	int i;
+
+	atomic_set(&ring->head, 0);
+	atomic_set(&ring->tail, 0);
+	atomic_set(&ring->lost, 0);
+	for (i = 0; i < PICONTROL_EVENT_RING_SIZE; i++)
+		atomic_set(&ring->slot[i].seq, i);
+}
+
+/*
+ * A slot at position pos is free for a producer if its seq is pos and filled
+ * for a consumer if its seq is pos + 1. The consumer releases it for the
+ * next round by setting seq to pos + PICONTROL_EVENT_RING_SIZE.
+ */
+static bool picontrol_event_push(struct picontrol_event_ring *ring,
+				 const struct picontrol_event *ev)
+{
+	int pos = atomic_read(&ring->head);
+	int diff;
+
+	for (;;) {
+		diff = atomic_read_acquire(&ring->slot[pos % PICONTROL_EVENT_RING_SIZE].seq) - pos;
+		if (diff == 0) {
+			if (atomic_try_cmpxchg(&ring->head, &pos, pos + 1))
+				break;
+		} else if (diff < 0) {
+			atomic_inc(&ring->lost);
+			return false;
+		} else {
+			pos = atomic_read(&ring->head);
+		}
+	}
+
+	ring->slot[pos % PICONTROL_EVENT_RING_SIZE].ev = *ev;
+	atomic_set_release(&ring->slot[pos % PICONTROL_EVENT_RING_SIZE].seq, pos + 1);
+	return true;
+}
+
+static bool picontrol_event_pop(struct picontrol_event_ring *ring,
+				struct picontrol_event *ev)
+{
+	int pos = atomic_read(&ring->tail);
+	int diff;
+
+	for (;;) {
+		diff = atomic_read_acquire(&ring->slot[pos % PICONTROL_EVENT_RING_SIZE].seq) - (pos + 1);
+		if (diff == 0) {
+			if (atomic_try_cmpxchg(&ring->tail, &pos, pos + 1))
+				break;
+		} else if (diff < 0) {
+			return false;	// empty
+		} else {
+			pos = atomic_read(&ring->tail);
+		}
+	}
+
+	*ev = ring->slot[pos % PICONTROL_EVENT_RING_SIZE].ev;
+	atomic_set_release(&ring->slot[pos % PICONTROL_EVENT_RING_SIZE].seq,
+			   pos + PICONTROL_EVENT_RING_SIZE);
+	return true;
+}
+
+static bool picontrol_event_pending(struct picontrol_event_ring *ring)
+{
+	return atomic_read(&ring->head) != atomic_read(&ring->tail);
+}
+
+/*
+ * Post an event to all open file handles except the given one. A reset is
+ * kept in a flag, so it is never lost to a full queue. The other events are
+ * only queued for file handles which fetch them with PICONTROL_GET_EVENTS.
+ * Must not be called with lockPI held.
+ */
+void picontrol_post_event(tpiControlInst *except, u32 type, u32 arg)
+{
+	struct picontrol_event ev = {
+		.type = type,
+		.arg = arg,
+		.cycle = picontrol_get_cycle(NULL),
+		.timestamp = ktime_get_ns(),
+	};
+	tpiControlInst *priv;
+
+	my_rt_mutex_lock(&piDev_g.lockListCon);
+	list_for_each_entry(priv, &piDev_g.listCon, list) {
+		if (priv == except)
+			continue;
+		if (type == KB_EVENT_RESET) {
+			priv->reset_event = ev;
+			set_bit(PICONTROL_INST_FLAG_RESET, &priv->event_flags);
+		} else if (test_bit(PICONTROL_INST_FLAG_GET_EVENTS,
+				    &priv->event_flags)) {
+			picontrol_event_push(&priv->events, &ev);
+		} else {
+			continue;
+		}
+		wake_up_interruptible(&priv->wq);
+	}
+	rt_mutex_unlock(&piDev_g.lockListCon);
+}
+
 static ssize_t last_cycle_show(struct device *dev,
 			       struct device_attribute *attr, char *buf)
 {
@@ -231,6 +545,88 @@ static ssize_t max_cycle_store(struct device *dev,
 	return count;
 }
 
+/* percentiles of the cycle histogram in units of 0.001 % */
+static const unsigned int picontrol_cycle_percentiles[] = {
+	50000, 90000, 99000, 99900, 99990,
+};
+
+/*
+ * Show the number of cycles, the percentiles and the non empty buckets
+ * "<lowest usecs> <highest usecs> <cycles>" of the cycle histogram. The
+ * percentiles are the highest cycle time of the bucket they fall into.
+ */
+static ssize_t cycle_histogram_show(struct device *dev,
+				    struct device_attribute *attr, char *buf)
+{
+	struct picontrol_cycle *cycle = &piDev_g.cycle;
+	unsigned int i, p = 0;
+	u64 total = 0, sum = 0, rank;
+	ssize_t len;
+	u64 *hist;
+
+	hist = kmalloc_array(PICONTROL_CYCLE_HIST_BUCKETS, sizeof(*hist),
+			     GFP_KERNEL);
+	if (!hist)
+		return -ENOMEM;
+
+	for (i = 0; i < PICONTROL_CYCLE_HIST_BUCKETS; i++) {
+		hist[i] = atomic64_read(&cycle->hist[i]);
+		total += hist[i];
+	}
+
+	len = scnprintf(buf, PAGE_SIZE, "cycles %llu\n", total);
+
+	for (i = 0; total && i < PICONTROL_CYCLE_HIST_BUCKETS; i++) {
+		sum += hist[i];
+		while (p < ARRAY_SIZE(picontrol_cycle_percentiles)) {
+			rank = DIV_ROUND_UP_ULL(total *
+						picontrol_cycle_percentiles[p],
+						100000);
+			if (sum < rank)
+				break;
+			len += scnprintf(buf + len, PAGE_SIZE - len,
+					 "p%u.%03u %u\n",
+					 picontrol_cycle_percentiles[p] / 1000,
+					 picontrol_cycle_percentiles[p] % 1000,
+					 picontrol_cycle_hist_lower(i + 1) - 1);
+			p++;
+		}
+	}
+
+	for (i = 0; i < PICONTROL_CYCLE_HIST_BUCKETS; i++) {
+		if (!hist[i])
+			continue;
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%u %u %llu\n",
+				 picontrol_cycle_hist_lower(i),
+				 i == PICONTROL_CYCLE_HIST_BUCKETS - 1 ? UINT_MAX :
+				 picontrol_cycle_hist_lower(i + 1) - 1,
+				 hist[i]);
+	}
+
+	kfree(hist);
+	return len;
+}
+
+static ssize_t cycle_histogram_store(struct device *dev,
+				     struct device_attribute *attr,
+				     const char *buf, size_t count)
+{
+	struct picontrol_cycle *cycle = &piDev_g.cycle;
+	unsigned long val;
+	unsigned int i;
+
+	if (kstrtoul(buf, 10, &val))
+		return -EINVAL;
+
+	if (val != 0)
+		return -EINVAL;
+
+	for (i = 0; i < PICONTROL_CYCLE_HIST_BUCKETS; i++)
+		atomic64_set(&cycle->hist[i], 0);
+
+	return count;
+}
+
 static ssize_t cycle_duration_show(struct device *dev,
 				   struct device_attribute *attr, char *buf)
 {
@@ -356,6 +752,170 @@ static ssize_t cycles_missed_store(struct device *dev,
 	return count;
 }
 
+/*
+ * One line "<address> <divider> <phase>" per module. Writing
+ * "<address> <divider>" changes the divider of a module and reschedules all
+ * modules. The I/O thread picks up the new values without a reset. The next
+ * reset sets the dividers from config.rsc again, see PiBridgeMaster_Adjust().
+ */
+static ssize_t cycle_dividers_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	ssize_t len = 0;
+	SDevice *sdev;
+	int i;
+
+	my_rt_mutex_lock(&piDev_g.lockIoctl);
+	for (i = 0; i < RevPiDevice_getDevCnt(); i++) {
+		sdev = RevPiDevice_getDev(i);
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%u %u %u\n",
+				 sdev->i8uAddress, sdev->i8uCycleDivider ?: 1,
+				 sdev->i8uCyclePhase);
+	}
+	rt_mutex_unlock(&piDev_g.lockIoctl);
+
+	return len;
+}
+
+static ssize_t cycle_dividers_store(struct device *dev,
+				    struct device_attribute *attr,
+				    const char *buf, size_t count)
+{
+	unsigned int address, divider;
+	SDevice *sdev;
+	int ret = -ENODEV;
+	int i;
+
+	if (sscanf(buf, "%u %u", &address, &divider) != 2)
+		return -EINVAL;
+
+	if (divider > REV_PI_DEV_MAX_DIVIDER)
+		return -EINVAL;
+
+	my_rt_mutex_lock(&piDev_g.lockIoctl);
+	/* RevPiDevice_isDue() reads divider and phase in the I/O thread */
+	if (piDev_g.pibridge_supported)
+		my_rt_mutex_lock(&piCore_g.lockBridgeState);
+	for (i = 0; i < RevPiDevice_getDevCnt(); i++) {
+		sdev = RevPiDevice_getDev(i);
+		if (sdev->i8uAddress == address) {
+			sdev->i8uCycleDivider = divider;
+			RevPiDevice_scheduleCycles();
+			ret = count;
+			break;
+		}
+	}
+	if (piDev_g.pibridge_supported)
+		rt_mutex_unlock(&piCore_g.lockBridgeState);
+	rt_mutex_unlock(&piDev_g.lockIoctl);
+
+	return ret;
+}
+
+static ssize_t picontrol_thread_prio_show(enum revpi_thread_id id, char *buf)
+{
+	return sprintf(buf, "%d\n", revpi_thread_get_prio(id));
+}
+
+static ssize_t picontrol_thread_prio_store(enum revpi_thread_id id,
+					   const char *buf, size_t count)
+{
+	int prio;
+	int ret;
+
+	if (kstrtoint(buf, 10, &prio))
+		return -EINVAL;
+
+	ret = revpi_thread_set_prio(id, prio);
+	if (ret)
+		return ret;
+
+	return count;
+}
+
+static ssize_t picontrol_thread_cpus_show(enum revpi_thread_id id, char *buf)
+{
+	cpumask_var_t cpus;
+	ssize_t len;
+
+	if (!zalloc_cpumask_var(&cpus, GFP_KERNEL))
+		return -ENOMEM;
+
+	revpi_thread_get_cpus(id, cpus);
+	len = sprintf(buf, "%*pbl\n", cpumask_pr_args(cpus));
+	free_cpumask_var(cpus);
+
+	return len;
+}
+
+static ssize_t picontrol_thread_cpus_store(enum revpi_thread_id id,
+					   const char *buf, size_t count)
+{
+	cpumask_var_t cpus;
+	int ret;
+
+	if (!zalloc_cpumask_var(&cpus, GFP_KERNEL))
+		return -ENOMEM;
+
+	ret = cpulist_parse(buf, cpus);
+	if (!ret)
+		ret = revpi_thread_set_cpus(id, cpus);
+	free_cpumask_var(cpus);
+	if (ret)
+		return ret;
+
+	return count;
+}
+
+/*
+ * <name>_prio: SCHED_FIFO priority of the thread, -1 if it does not run.
+ * Writing -1 restores the default priority.
+ * <name>_cpus: cpus the thread may run on, empty for all cpus.
+ */
+#define PICONTROL_THREAD_ATTRS(_name, _id)					\
+static ssize_t _name##_prio_show(struct device *dev,			\
+				 struct device_attribute *attr, char *buf)	\
+{										\
+	return picontrol_thread_prio_show(_id, buf);				\
+}										\
+static ssize_t _name##_prio_store(struct device *dev,			\
+				  struct device_attribute *attr,		\
+				  const char *buf, size_t count)		\
+{										\
+	return picontrol_thread_prio_store(_id, buf, count);			\
+}										\
+static ssize_t _name##_cpus_show(struct device *dev,			\
+				 struct device_attribute *attr, char *buf)	\
+{										\
+	return picontrol_thread_cpus_show(_id, buf);				\
+}										\
+static ssize_t _name##_cpus_store(struct device *dev,			\
+				  struct device_attribute *attr,		\
+				  const char *buf, size_t count)		\
+{										\
+	return picontrol_thread_cpus_store(_id, buf, count);			\
+}										\
+static DEVICE_ATTR_RW(_name##_prio);						\
+static DEVICE_ATTR_RW(_name##_cpus)
+
+PICONTROL_THREAD_ATTRS(io_thread, REVPI_THREAD_IO);
+PICONTROL_THREAD_ATTRS(ain_thread, REVPI_THREAD_AIN);
+PICONTROL_THREAD_ATTRS(gate_thread, REVPI_THREAD_GATE);
+
+static struct attribute *picontrol_thread_attrs[] = {
+	&dev_attr_io_thread_prio.attr,
+	&dev_attr_io_thread_cpus.attr,
+	&dev_attr_ain_thread_prio.attr,
+	&dev_attr_ain_thread_cpus.attr,
+	&dev_attr_gate_thread_prio.attr,
+	&dev_attr_gate_thread_cpus.attr,
+	NULL
+};
+
+static const struct attribute_group picontrol_thread_group = {
+	.attrs = picontrol_thread_attrs,
+};
+
 static DEVICE_ATTR_RW(cycle_duration);
 static DEVICE_ATTR_RW(max_cycle);
 static DEVICE_ATTR_RW(min_cycle);
@@ -363,6 +923,8 @@ static DEVICE_ATTR_RO(last_cycle);
 static DEVICE_ATTR_RW(max_cycle_deviation);
 static DEVICE_ATTR_RW(cycles_exceeded);
 static DEVICE_ATTR_RW(cycles_missed);
+static DEVICE_ATTR_RW(cycle_dividers);
+static DEVICE_ATTR_RW(cycle_histogram);
 
 static int piControl_init_sysfs(void)
 {
@@ -396,8 +958,26 @@ static int piControl_init_sysfs(void)
 	if (ret)
 		goto remove_exceeded_cycles_file;
 
+	ret = sysfs_create_file(&piDev_g.dev->kobj, &dev_attr_cycle_dividers.attr);
+	if (ret)
+		goto remove_missed_cycles_file;
+
+	ret = sysfs_create_file(&piDev_g.dev->kobj, &dev_attr_cycle_histogram.attr);
+	if (ret)
+		goto remove_cycle_dividers_file;
+
+	ret = sysfs_create_group(&piDev_g.dev->kobj, &picontrol_thread_group);
+	if (ret)
+		goto remove_cycle_histogram_file;
+
 	return 0;
 
+remove_cycle_histogram_file:
+	sysfs_remove_file(&piDev_g.dev->kobj, &dev_attr_cycle_histogram.attr);
+remove_cycle_dividers_file:
+	sysfs_remove_file(&piDev_g.dev->kobj, &dev_attr_cycle_dividers.attr);
+remove_missed_cycles_file:
+	sysfs_remove_file(&piDev_g.dev->kobj, &dev_attr_cycles_missed.attr);
 remove_exceeded_cycles_file:
 	sysfs_remove_file(&piDev_g.dev->kobj, &dev_attr_cycles_exceeded.attr);
 remove_max_cycle_deviation_file:
@@ -416,6 +996,9 @@ remove_cycle_duration_file:
 
 static void piControl_deinit_sysfs(void)
 {
+	sysfs_remove_group(&piDev_g.dev->kobj, &picontrol_thread_group);
+	sysfs_remove_file(&piDev_g.dev->kobj, &dev_attr_cycle_histogram.attr);
+	sysfs_remove_file(&piDev_g.dev->kobj, &dev_attr_cycle_dividers.attr);
 	sysfs_remove_file(&piDev_g.dev->kobj, &dev_attr_cycles_missed.attr);
 	sysfs_remove_file(&piDev_g.dev->kobj, &dev_attr_cycles_exceeded.attr);
 	sysfs_remove_file(&piDev_g.dev->kobj, &dev_attr_max_cycle_deviation.attr);
@@ -481,6 +1064,7 @@ static int pibridge_probe(struct platform_device *pdev)
 	}
 
 	seqlock_init(&piDev_g.cycle.lock);
+	init_waitqueue_head(&piDev_g.cycle.wq);
 
 	piDev_g.cycle.duration = PICONTROL_DEFAULT_CYCLE_DURATION;
 	if (picontrol_cycle_duration) {
@@ -531,6 +1115,9 @@ static int pibridge_probe(struct platform_device *pdev)
 
 	INIT_LIST_HEAD(&piDev_g.listCon);
 	rt_mutex_init(&piDev_g.lockListCon);
+	INIT_LIST_HEAD(&piDev_g.listWatch);
+	rt_mutex_init(&piDev_g.lockWatch);
+	INIT_LIST_HEAD(&piDev_g.listCommit);
 
 	cdev_init(&piDev_g.cdev, &piControlFops);
 	piDev_g.cdev.owner = THIS_MODULE;
@@ -545,12 +1132,18 @@ static int pibridge_probe(struct platform_device *pdev)
 
 	pr_debug("MAJOR-No.  : %d  MINOR-No.  : %d\n", MAJOR(curdev), MINOR(curdev));
 
+	revpi_threads_init();
+
 	res = piControl_init_sysfs();
 	if (res) {
 		pr_err("Failed to create sysfs entries: %i\n", res);
 		goto err_dev_destroy;
 	}
 
+	piDev_g.debugfs = debugfs_create_dir("piControl", NULL);
+	RevPiDevice_debugfs_init(piDev_g.debugfs);
+	piConfigDebugfsInit(piDev_g.debugfs);
+
 	res = devm_led_trigger_register(piDev_g.dev, &piDev_g.power_red)
 	   || devm_led_trigger_register(piDev_g.dev, &piDev_g.a1_green)
 	   || devm_led_trigger_register(piDev_g.dev, &piDev_g.a1_red)
@@ -593,6 +1186,22 @@ static int pibridge_probe(struct platform_device *pdev)
 		goto err_sysfs_remove;
 	}
 
+	/*
+	 * The process image and the status page are allocated page-wise to be
+	 * able to map them to userspace.
+	 */
+	BUILD_BUG_ON(KB_PI_LEN > PAGE_SIZE);
+	piDev_g.ai8uPI = (u8 *) get_zeroed_page(GFP_KERNEL);
+	piDev_g.mmap_status = (struct picontrol_mmap_status *)
+		get_zeroed_page(GFP_KERNEL);
+	piDev_g.pi_published = (u8 *) __get_free_pages(GFP_KERNEL | __GFP_ZERO,
+						       1);
+	if (!piDev_g.ai8uPI || !piDev_g.mmap_status || !piDev_g.pi_published) {
+		pr_err("cannot allocate process image\n");
+		res = -ENOMEM;
+		goto err_free_image;
+	}
+
 	/* init some data */
 	rt_mutex_init(&piDev_g.lockPI);
 	rt_mutex_init(&piDev_g.lockIoctl);
@@ -603,7 +1212,8 @@ static int pibridge_probe(struct platform_device *pdev)
 
 	/* start application */
 	piConfigParse(PICONFIG_FILE, &piDev_g.devs, &piDev_g.ent, &piDev_g.cl,
-		      &piDev_g.connl);
+		      &piDev_g.connl, true);
+	piDev_g.connp = piConfigCompileConnections(piDev_g.connl);
 
 	if (piDev_g.pibridge_supported) {
 		res = revpi_core_probe(pdev);
@@ -648,7 +1258,13 @@ err_free_config:
 	kfree(piDev_g.devs);
 	kfree(piDev_g.cl);
 	kfree(piDev_g.connl);
+	kvfree(piDev_g.connp);
+err_free_image:
+	free_pages((unsigned long) piDev_g.pi_published, 1);
+	free_page((unsigned long) piDev_g.mmap_status);
+	free_page((unsigned long) piDev_g.ai8uPI);
 err_sysfs_remove:
+	debugfs_remove_recursive(piDev_g.debugfs);
 	piControl_deinit_sysfs();
 err_dev_destroy:
 	device_destroy(piControlClass, curdev);
@@ -662,26 +1278,66 @@ err_unreg_chrdev_region:
 /*****************************************************************************/
 /*       C L E A N U P                                                       */
 /*****************************************************************************/
+/*
+ * Replace the configuration. The pointers are swapped under lockPI, so the
+ * I/O cycle never uses a freed config, and the old config is freed
+ * afterwards. The PiBridge state machine reads devs and ent under
+ * lockBridgeState only, e.g. in PiBridgeMaster_Adjust(), so it is taken as
+ * well. The ioctls using the config outside of lockPI hold lockIoctl, which
+ * the caller must hold as well.
+ */
+static void picontrol_replace_config(piDevices *devs, piEntries *ent,
+				     piCopylist *cl, piConnectionList *connl,
+				     piConnectionProgram *connp)
+{
+	piDevices *old_devs;
+	piEntries *old_ent;
+	piCopylist *old_cl;
+	piConnectionList *old_connl;
+	piConnectionProgram *old_connp;
+
+	if (piDev_g.pibridge_supported)
+		my_rt_mutex_lock(&piCore_g.lockBridgeState);
+	my_rt_mutex_lock(&piDev_g.lockPI);
+	old_devs = piDev_g.devs;
+	old_ent = piDev_g.ent;
+	old_cl = piDev_g.cl;
+	old_connl = piDev_g.connl;
+	old_connp = piDev_g.connp;
+	piDev_g.devs = devs;
+	piDev_g.ent = ent;
+	piDev_g.cl = cl;
+	piDev_g.connl = connl;
+	piDev_g.connp = connp;
+	piDev_g.config_gen++;
+	rt_mutex_unlock(&piDev_g.lockPI);
+	if (piDev_g.pibridge_supported)
+		rt_mutex_unlock(&piCore_g.lockBridgeState);
+
+	kvfree(old_connp);
+	kfree(old_connl);
+	kfree(old_cl);
+	kfree(old_ent);
+	kfree(old_devs);
+}
+
 static int piControlReset(tpiControlInst * priv)
 {
 	int status = -EFAULT;
 	int timeout = 10000;	// ms
 
-	kfree(piDev_g.ent);
-	piDev_g.ent = NULL;
-
-	kfree(piDev_g.devs);
-	piDev_g.devs = NULL;
-
-	kfree(piDev_g.cl);
-	piDev_g.cl = NULL;
+	piDevices *devs;
+	piEntries *ent;
+	piCopylist *cl;
+	piConnectionList *connl;
 
-	kfree(piDev_g.connl);
-	piDev_g.connl = NULL;
+	/* stop using the config in the I/O cycle before it is freed */
+	picontrol_replace_config(NULL, NULL, NULL, NULL, NULL);
 
 	/* start application */
-	piConfigParse(PICONFIG_FILE, &piDev_g.devs, &piDev_g.ent, &piDev_g.cl,
-		      &piDev_g.connl);
+	piConfigParse(PICONFIG_FILE, &devs, &ent, &cl, &connl, true);
+	picontrol_replace_config(devs, ent, cl, connl,
+				 piConfigCompileConnections(connl));
 
 	if (piDev_g.machine_type == REVPI_COMPACT) {
 		revpi_compact_reset();
@@ -694,49 +1350,66 @@ static int piControlReset(tpiControlInst * priv)
 	if (!waitRunning(timeout)) {
 		status = -ETIMEDOUT;
 	} else {
-		struct list_head *pCon;
-
-		my_rt_mutex_lock(&piDev_g.lockListCon);
-		list_for_each(pCon, &piDev_g.listCon) {
-			tpiControlInst *pos_inst;
-			pos_inst = list_entry(pCon, tpiControlInst, list);
-			if (pos_inst != priv) {
-				struct list_head *pEv;
-				tpiEventEntry *pEntry;
-				bool found = false;
-
-				// add the event to the list only, if it not already there
-				my_rt_mutex_lock(&pos_inst->lockEventList);
-				list_for_each(pEv, &pos_inst->piEventList) {
-					pEntry = list_entry(pEv, tpiEventEntry, list);
-					if (pEntry->event == piEvReset) {
-						found = true;
-						break;
-					}
-				}
-
-				if (!found) {
-					pEntry = kmalloc(sizeof(tpiEventEntry), GFP_KERNEL);
-					if (pEntry) {
-						pEntry->event = piEvReset;
-						list_add_tail(&pEntry->list,
-							      &pos_inst->piEventList);
-					}
-					rt_mutex_unlock(&pos_inst->lockEventList);
-					if (pEntry)
-						wake_up(&pos_inst->wq);
-				} else {
-					rt_mutex_unlock(&pos_inst->lockEventList);
-				}
-			}
-		}
-		rt_mutex_unlock(&piDev_g.lockListCon);
+		picontrol_post_event(priv, KB_EVENT_RESET, 0);
+		picontrol_post_event(NULL, KB_EVENT_CONFIG_RELOADED, 0);
 
 		status = 0;
 	}
 	return status;
 }
 
+/*
+ * Load the configuration file again without stopping the I/O communication.
+ * This is only possible if the modules and their position in the process
+ * image did not change, see piConfigSameLayout(). Otherwise the driver is
+ * reset. Returns 0 if the configuration was applied while running and 1 if
+ * a reset was necessary.
+ */
+static int piControlReload(tpiControlInst *priv)
+{
+	piDevices *devs;
+	piEntries *ent;
+	piCopylist *cl;
+	piConnectionList *connl;
+	int status;
+
+	if (!piDev_g.devs || !piDev_g.ent)
+		goto reset;
+
+	if (piConfigParse(PICONFIG_FILE, &devs, &ent, &cl, &connl, false))
+		goto free_config;
+
+	if (!devs || !ent || !cl)
+		goto free_config;
+
+	if (!piConfigSameLayout(piDev_g.devs, piDev_g.ent, devs, ent)) {
+		pr_info("module layout changed -> reset\n");
+		goto free_config;
+	}
+
+	picontrol_replace_config(devs, ent, cl, connl,
+				 piConfigCompileConnections(connl));
+
+	/* used by the next reset, the process image keeps its values */
+	if (piDev_g.pibridge_supported)
+		PiBridgeMaster_setDefaults();
+
+	pr_info("configuration reloaded without reset\n");
+	picontrol_post_event(NULL, KB_EVENT_CONFIG_RELOADED, 0);
+	return 0;
+
+free_config:
+	kfree(connl);
+	kfree(cl);
+	kfree(ent);
+	kfree(devs);
+reset:
+	if (piDev_g.pibridge_supported && isRunning())
+		PiBridgeMaster_Pause();
+	status = piControlReset(priv);
+	return status ? status : 1;
+}
+
 #if KERNEL_VERSION(6, 11, 0) <= LINUX_VERSION_CODE
 static void pibridge_remove(struct platform_device *pdev)
 #else
@@ -764,6 +1437,11 @@ static int pibridge_remove(struct platform_device *pdev)
 	kfree(piDev_g.devs);
 	kfree(piDev_g.cl);
 	kfree(piDev_g.connl);
+	kvfree(piDev_g.connp);
+	free_pages((unsigned long) piDev_g.pi_published, 1);
+	free_page((unsigned long) piDev_g.mmap_status);
+	free_page((unsigned long) piDev_g.ai8uPI);
+	debugfs_remove_recursive(piDev_g.debugfs);
 	piControl_deinit_sysfs();
 	curdev = MKDEV(MAJOR(piControlMajor), MINOR(piControlMajor));
 	device_destroy(piControlClass, curdev);
@@ -821,6 +1499,118 @@ void printUserMsg(tpiControlInst *priv, const char *s, ...)
 	pr_info("%s", priv->pcErrorMessage);
 }
 
+/*****************************************************************************/
+/*              W A T C H D O G                                              */
+/*****************************************************************************/
+/* Set the outputs of the instance to 0, called with lockPI held. */
+static void picontrol_watchdog_zero(tpiControlInst *priv)
+{
+	int i;
+
+	if (priv->wd_owned) {
+		for (i = 0; i < KB_PI_LEN; i++)
+			piDev_g.ai8uPI[i] &= ~priv->wd_owned[i];
+		return;
+	}
+
+	for (i = 0; i < RevPiDevice_getDevCnt(); i++) {
+		if (RevPiDevice_getDev(i)->i8uActive) {
+			memset(piDev_g.ai8uPI + RevPiDevice_getDev(i)->i16uOutputOffset, 0, RevPiDevice_getDev(i)->sId.i16uFBS_OutputLength);
+		}
+	}
+}
+
+/*
+ * Retriggering the watchdog only moves tTimeoutTS. The timer checks it when
+ * it expires and is forwarded if the deadline was moved in the meantime.
+ */
+static enum hrtimer_restart picontrol_watchdog_timer(struct hrtimer *timer)
+{
+	tpiControlInst *priv = container_of(timer, tpiControlInst, wd_timer);
+	ktime_t deadline = atomic64_read(&priv->tTimeoutTS);
+
+	if (!READ_ONCE(priv->tTimeoutDurationMs))
+		return HRTIMER_NORESTART;
+
+	if (ktime_before(hrtimer_cb_get_time(timer), deadline)) {
+		hrtimer_set_expires(timer, deadline);
+		return HRTIMER_RESTART;
+	}
+
+	/* lockPI cannot be taken in timer context */
+	queue_work(system_highpri_wq, &priv->wd_work);
+	return HRTIMER_NORESTART;
+}
+
+static void picontrol_watchdog_work(struct work_struct *work)
+{
+	tpiControlInst *priv = container_of(work, tpiControlInst, wd_work);
+	unsigned long period = READ_ONCE(priv->tTimeoutDurationMs);
+	ktime_t deadline;
+
+	if (!period)
+		return;
+
+	my_rt_mutex_lock(&piDev_g.lockPI);
+	picontrol_watchdog_zero(priv);
+	picontrol_publish_image(0, KB_PI_LEN);
+	rt_mutex_unlock(&piDev_g.lockPI);
+
+	/* set the outputs to 0 again after each period until retriggered */
+	deadline = ktime_add_ms(ktime_get(), period);
+	atomic64_set(&priv->tTimeoutTS, deadline);
+	hrtimer_start(&priv->wd_timer, deadline, HRTIMER_MODE_ABS);
+}
+
+static void picontrol_watchdog_retrigger(tpiControlInst *priv)
+{
+	unsigned long period = READ_ONCE(priv->tTimeoutDurationMs);
+
+	if (period > 0)
+		atomic64_set(&priv->tTimeoutTS, ktime_add_ms(ktime_get(), period));
+}
+
+static void picontrol_watchdog_stop(tpiControlInst *priv)
+{
+	WRITE_ONCE(priv->tTimeoutDurationMs, 0);
+	hrtimer_cancel(&priv->wd_timer);
+	cancel_work_sync(&priv->wd_work);
+	/* the work may have restarted the timer */
+	hrtimer_cancel(&priv->wd_timer);
+}
+
+static int picontrol_watchdog_start(tpiControlInst *priv, unsigned long period)
+{
+	bool own = period & PICONTROL_WATCHDOG_OWN_OUTPUTS;
+	u8 *owned = NULL, *old;
+	ktime_t deadline;
+
+	period &= ~PICONTROL_WATCHDOG_OWN_OUTPUTS;
+	if (period && own) {
+		owned = kvzalloc(KB_PI_LEN, GFP_KERNEL);
+		if (!owned)
+			return -ENOMEM;
+	}
+
+	picontrol_watchdog_stop(priv);
+
+	my_rt_mutex_lock(&piDev_g.lockPI);
+	old = priv->wd_owned;
+	priv->wd_owned = owned;
+	rt_mutex_unlock(&piDev_g.lockPI);
+	kvfree(old);
+
+	if (!period)
+		return 0;
+
+	deadline = ktime_add_ms(ktime_get(), period);
+	atomic64_set(&priv->tTimeoutTS, deadline);
+	WRITE_ONCE(priv->tTimeoutDurationMs, period);
+	hrtimer_start(&priv->wd_timer, deadline, HRTIMER_MODE_ABS);
+
+	return 0;
+}
+
 /*****************************************************************************/
 /*              O P E N                                                      */
 /*****************************************************************************/
@@ -836,11 +1626,23 @@ static int piControlOpen(struct inode *inode, struct file *file)
 
 	/* initalize instance variables */
 	priv->dev = piDev_g.dev;
-	INIT_LIST_HEAD(&priv->piEventList);
-	rt_mutex_init(&priv->lockEventList);
+	picontrol_event_ring_init(&priv->events);
+#if KERNEL_VERSION(6, 13, 0) > LINUX_VERSION_CODE
+	hrtimer_init(&priv->wd_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	priv->wd_timer.function = picontrol_watchdog_timer;
+#else
+	hrtimer_setup(&priv->wd_timer, picontrol_watchdog_timer,
+		      CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+#endif
+	INIT_WORK(&priv->wd_work, picontrol_watchdog_work);
 
 	init_waitqueue_head(&priv->wq);
 
+	priv->last_cycle = picontrol_get_cycle(NULL);
+	INIT_LIST_HEAD(&priv->watch_list);
+	rt_mutex_init(&priv->lockStaging);
+	INIT_LIST_HEAD(&priv->commit_list);
+
 	my_rt_mutex_lock(&piDev_g.lockListCon);
 	list_add(&priv->list, &piDev_g.listCon);
 	rt_mutex_unlock(&piDev_g.lockListCon);
@@ -854,154 +1656,507 @@ static int piControlOpen(struct inode *inode, struct file *file)
 static int piControlRelease(struct inode *inode, struct file *file)
 {
 	tpiControlInst *priv;
-	struct list_head *pos, *n;
+	bool wd_active;
 
 	priv = (tpiControlInst *) file->private_data;
 
-	if (priv->tTimeoutDurationMs > 0) {
-		// if the watchdog is active, set all outputs to 0
-		int i;
-		my_rt_mutex_lock(&piDev_g.lockPI);
-		for (i = 0; i < RevPiDevice_getDevCnt(); i++) {
-			if (RevPiDevice_getDev(i)->i8uActive) {
-				memset(piDev_g.ai8uPI + RevPiDevice_getDev(i)->i16uOutputOffset, 0, RevPiDevice_getDev(i)->sId.i16uFBS_OutputLength);
-			}
+	wd_active = priv->tTimeoutDurationMs > 0;
+	picontrol_watchdog_stop(priv);
+
+	my_rt_mutex_lock(&piDev_g.lockPI);
+	/* outputs committed right before close are not lost */
+	if (!list_empty(&priv->commit_list)) {
+		picontrol_apply_staging(priv);
+		list_del(&priv->commit_list);
+	}
+	// if the watchdog is active, set the outputs to 0
+	if (wd_active)
+		picontrol_watchdog_zero(priv);
+	picontrol_publish_image(0, KB_PI_LEN);
+	rt_mutex_unlock(&piDev_g.lockPI);
+	kvfree(priv->staging);
+	kvfree(priv->wd_owned);
+
+	my_rt_mutex_lock(&piDev_g.lockListCon);
+	list_del(&priv->list);
+	rt_mutex_unlock(&piDev_g.lockListCon);
+
+	my_rt_mutex_lock(&piDev_g.lockWatch);
+	list_del(&priv->watch_list);
+	rt_mutex_unlock(&piDev_g.lockWatch);
+	kfree(priv->watches);
+	kfree(priv->watch_shadow);
+
+	kfree(priv);
+
+	return 0;
+}
+
+/*****************************************************************************/
+/*    R E A D                                                                */
+/*****************************************************************************/
+static ssize_t piControlReadIter(struct kiocb *iocb, struct iov_iter *to)
+{
+	tpiControlInst *priv;
+	const u8 *img;
+	size_t nread = iov_iter_count(to);
+	loff_t pos = iocb->ki_pos;
+	unsigned int seq;
+	bool retry;
+
+	if (!isRunning())
+		return -EAGAIN;
+
+	priv = (tpiControlInst *) iocb->ki_filp->private_data;
+
+	dev_dbg(priv->dev, "piControlRead Count: %zu, Pos: %llu", nread, pos);
+
+	if (pos < 0 || pos >= KB_PI_LEN) {
+		return 0;	// end of file
+	}
+
+	if (nread + pos > KB_PI_LEN) {
+		nread = KB_PI_LEN - pos;
+	}
+
+	/*
+	 * Read from the published image, the I/O cycle is never blocked. All
+	 * buffers of a vectored read are filled from the same cycle.
+	 */
+	do {
+		seq = picontrol_published_begin(&img);
+		if (copy_to_iter(img + pos, nread, to) != nread) {
+			pr_err("piControlRead: copy_to_iter failed");
+			return -EFAULT;
 		}
-		rt_mutex_unlock(&piDev_g.lockPI);
+		retry = picontrol_published_retry(seq);
+		if (retry)
+			iov_iter_revert(to, nread);
+	} while (retry);
+
+	iocb->ki_pos += nread;
+
+	return nread;		// length read
+}
+
+/*****************************************************************************/
+/*    W R I T E                                                              */
+/*****************************************************************************/
+/*
+ * Outputs are written to the staging buffer of the file handle if an output
+ * transaction is open, otherwise to the process image. Returns the staging
+ * buffer with lockStaging held or NULL with lockPI held.
+ */
+static struct picontrol_staging *picontrol_output_lock(tpiControlInst *priv)
+{
+	my_rt_mutex_lock(&priv->lockStaging);
+	if (priv->staging_open)
+		return priv->staging;
+	rt_mutex_unlock(&priv->lockStaging);
+
+	my_rt_mutex_lock(&piDev_g.lockPI);
+	return NULL;
+}
+
+static void picontrol_output_unlock(tpiControlInst *priv,
+				    struct picontrol_staging *st,
+				    unsigned int start, unsigned int end)
+{
+	if (st) {
+		if (start < end) {
+			st->start = min(st->start, start);
+			st->end = max(st->end, end);
+		}
+		rt_mutex_unlock(&priv->lockStaging);
+		return;
+	}
+
+	if (start < end)
+		picontrol_publish_image(start, end - start);
+	rt_mutex_unlock(&piDev_g.lockPI);
+}
+
+/* Set the bits in mask of one byte of the outputs. */
+static void picontrol_output_byte(tpiControlInst *priv,
+				  struct picontrol_staging *st,
+				  unsigned int addr, u8 val, u8 mask)
+{
+	u8 *img = st ? st->data : piDev_g.ai8uPI;
+
+	img[addr] = (img[addr] & ~mask) | (val & mask);
+	if (st)
+		st->mask[addr] |= mask;
+	else if (priv->wd_owned)
+		priv->wd_owned[addr] |= mask;
+}
+
+static ssize_t piControlWriteIter(struct kiocb *iocb, struct iov_iter *from)
+{
+	tpiControlInst *priv;
+	struct picontrol_staging *st;
+	u8 *pPd;
+	size_t nwrite = iov_iter_count(from);
+	loff_t pos = iocb->ki_pos;
+
+	if (!isRunning())
+		return -EAGAIN;
+
+	priv = (tpiControlInst *) iocb->ki_filp->private_data;
+
+	dev_dbg(priv->dev, "piControlWrite Count: %zu, Pos: %llu", nwrite, pos);
+
+	if (pos < 0 || pos >= KB_PI_LEN) {
+		return 0;	// end of file
+	}
+
+	if (nwrite + pos > KB_PI_LEN) {
+		nwrite = KB_PI_LEN - pos;
+	}
+
+	/* all buffers of a vectored write are written with one lock hold */
+	st = picontrol_output_lock(priv);
+	pPd = (st ? st->data : piDev_g.ai8uPI) + pos;
+
+	if (copy_from_iter(pPd, nwrite, from) != nwrite) {
+		picontrol_output_unlock(priv, st, 0, 0);
+		pr_err("piControlWrite: copy_from_iter failed");
+		return -EFAULT;
+	}
+	if (st)
+		memset(st->mask + pos, 0xff, nwrite);
+	else if (priv->wd_owned)
+		memset(priv->wd_owned + pos, 0xff, nwrite);
+	picontrol_output_unlock(priv, st, pos, pos + nwrite);
+	iocb->ki_pos += nwrite;
+
+	picontrol_watchdog_retrigger(priv);
+
+	return nwrite;		// length written
+}
+
+/*****************************************************************************/
+/*    S E E K                                                           */
+/*****************************************************************************/
+static loff_t piControlSeek(struct file *file, loff_t off, int whence)
+{
+	tpiControlInst *priv;
+	loff_t newpos;
+
+	if (!isRunning())
+		return -EAGAIN;
+
+	priv = (tpiControlInst *) file->private_data;
+
+	switch (whence) {
+	case 0:		/* SEEK_SET */
+		newpos = off;
+		break;
+
+	case 1:		/* SEEK_CUR */
+		newpos = file->f_pos + off;
+		break;
+
+	case 2:		/* SEEK_END */
+		newpos = KB_PI_LEN + off;
+		break;
+
+	default:		/* can't happen */
+		return -EINVAL;
+	}
+
+	if (newpos < 0 || newpos >= KB_PI_LEN)
+		return -EINVAL;
+
+	file->f_pos = newpos;
+	return newpos;
+}
+
+/*****************************************************************************/
+/*    M M A P                                                                */
+/*****************************************************************************/
+static int piControlMmap(struct file *file, struct vm_area_struct *vma)
+{
+	unsigned long size = vma->vm_end - vma->vm_start;
+	unsigned long max_size = PAGE_SIZE;
+	bool read_only = true;
+	void *mem;
+
+	switch (vma->vm_pgoff) {
+	case PICONTROL_MMAP_PGOFF_IMAGE:
+		mem = piDev_g.ai8uPI;
+		read_only = false;
+		break;
+	case PICONTROL_MMAP_PGOFF_STATUS:
+		mem = piDev_g.mmap_status;
+		break;
+	case PICONTROL_MMAP_PGOFF_PUBLISHED:
+		mem = piDev_g.pi_published;
+		max_size = 2 * PAGE_SIZE;
+		break;
+	case PICONTROL_MMAP_PGOFF_PUBLISHED + 1:
+		mem = piDev_g.pi_published + PAGE_SIZE;
+		break;
+	default:
+		return -EINVAL;
 	}
 
-	my_rt_mutex_lock(&piDev_g.lockListCon);
-	list_del(&priv->list);
-	rt_mutex_unlock(&piDev_g.lockListCon);
+	if (size > max_size)
+		return -EINVAL;
+
+	if (read_only) {
+		/* only written by the driver */
+		if (vma->vm_flags & VM_WRITE)
+			return -EPERM;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 3, 0)
+		vma->vm_flags &= ~VM_MAYWRITE;
+#else
+		vm_flags_clear(vma, VM_MAYWRITE);
+#endif
+	}
+
+	return remap_pfn_range(vma, vma->vm_start,
+			       virt_to_phys(mem) >> PAGE_SHIFT, size,
+			       vma->vm_page_prot);
+}
+
+/*****************************************************************************/
+/*    P O L L                                                                */
+/*****************************************************************************/
+static __poll_t piControlPoll(struct file *file, poll_table *wait)
+{
+	tpiControlInst *priv = (tpiControlInst *) file->private_data;
+	__poll_t mask = 0;
+
+	poll_wait(file, &piDev_g.cycle.wq, wait);
+
+	poll_wait(file, &priv->wq, wait);
+
+	/* a cycle has ended which was not yet fetched with WAIT_FOR_CYCLE */
+	if (picontrol_get_cycle(NULL) != priv->last_cycle)
+		mask |= EPOLLIN | EPOLLRDNORM;
+
+	/* a watched range has changed, see KB_GET_CHANGES */
+	if (READ_ONCE(priv->changes.changed))
+		mask |= EPOLLPRI;
+
+	return mask;
+}
+
+static int picontrol_get_events(tpiControlInst *priv, struct file *file,
+				unsigned long usr_addr)
+{
+	struct picontrol_event __user *usr_ev;
+	struct picontrol_events args;
+	struct picontrol_event ev;
+	unsigned int n = 0;
+	int ret;
+
+	if (copy_from_user(&args, (const void __user *) usr_addr, sizeof(args)))
+		return -EFAULT;
+
+	if (!args.count)
+		return -EINVAL;
+
+	/* queue the events for this file handle from now on */
+	set_bit(PICONTROL_INST_FLAG_GET_EVENTS, &priv->event_flags);
+
+	usr_ev = u64_to_user_ptr(args.events);
+	do {
+		if (!(file->f_flags & O_NONBLOCK)) {
+			ret = wait_event_interruptible(priv->wq,
+					test_bit(PICONTROL_INST_FLAG_RESET, &priv->event_flags) ||
+					picontrol_event_pending(&priv->events));
+			if (ret)
+				return ret;
+		}
+
+		/* a reset is reported before the queued events */
+		my_rt_mutex_lock(&piDev_g.lockListCon);
+		if (test_and_clear_bit(PICONTROL_INST_FLAG_RESET,
+				       &priv->event_flags)) {
+			ev = priv->reset_event;
+			rt_mutex_unlock(&piDev_g.lockListCon);
+			if (copy_to_user(&usr_ev[n], &ev, sizeof(ev)))
+				return -EFAULT;
+			n++;
+		} else {
+			rt_mutex_unlock(&piDev_g.lockListCon);
+		}
+
+		while (n < args.count && picontrol_event_pop(&priv->events, &ev)) {
+			if (copy_to_user(&usr_ev[n], &ev, sizeof(ev)))
+				return -EFAULT;
+			n++;
+		}
+	} while (!n && !(file->f_flags & O_NONBLOCK));
+
+	args.count = n;
+	args.lost = atomic_xchg(&priv->events.lost, 0);
+
+	if (copy_to_user((void __user *) usr_addr, &args, sizeof(args)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static int picontrol_wait_for_cycle(tpiControlInst *priv,
+				    unsigned long usr_addr)
+{
+	struct picontrol_cycle_info info;
+	int ret;
+
+	ret = wait_event_interruptible(piDev_g.cycle.wq,
+			picontrol_get_cycle(&info) != priv->last_cycle);
+	if (ret)
+		return ret;
 
-	list_for_each_safe(pos, n, &priv->piEventList) {
-		tpiEventEntry *pos_inst;
-		pos_inst = list_entry(pos, tpiEventEntry, list);
-		list_del(pos);
-		kfree(pos_inst);
-	}
+	priv->last_cycle = info.cycle;
 
-	kfree(priv);
+	if (usr_addr && copy_to_user((void __user *) usr_addr, &info,
+				     sizeof(info)))
+		return -EFAULT;
 
 	return 0;
 }
 
-/*****************************************************************************/
-/*    R E A D                                                                */
-/*****************************************************************************/
-static ssize_t piControlRead(struct file *file, char __user * pBuf, size_t count, loff_t * ppos)
+static int picontrol_begin_outputs(tpiControlInst *priv)
 {
-	tpiControlInst *priv;
-	u8 *pPd;
-	size_t nread = count;
-
-	if (!isRunning())
-		return -EAGAIN;
+	int ret;
 
-	priv = (tpiControlInst *) file->private_data;
+	for (;;) {
+		/* the staging buffer is in use until a commit is applied */
+		ret = wait_event_interruptible(priv->wq,
+				list_empty_careful(&priv->commit_list));
+		if (ret)
+			return ret;
 
-	dev_dbg(priv->dev, "piControlRead Count: %zu, Pos: %llu", count, *ppos);
+		my_rt_mutex_lock(&priv->lockStaging);
+		if (list_empty_careful(&priv->commit_list))
+			break;
+		rt_mutex_unlock(&priv->lockStaging);
+	}
 
-	if (*ppos < 0 || *ppos >= KB_PI_LEN) {
-		return 0;	// end of file
+	if (priv->staging_open) {
+		ret = -EBUSY;
+	} else if (!priv->staging) {
+		priv->staging = kvzalloc(sizeof(*priv->staging), GFP_KERNEL);
+		if (!priv->staging)
+			ret = -ENOMEM;
+		else
+			priv->staging->start = KB_PI_LEN;
 	}
 
-	if (nread + *ppos > KB_PI_LEN) {
-		nread = KB_PI_LEN - *ppos;
+	if (!ret)
+		priv->staging_open = true;
+	rt_mutex_unlock(&priv->lockStaging);
+
+	return ret;
+}
+
+static int picontrol_commit_outputs(tpiControlInst *priv)
+{
+	my_rt_mutex_lock(&priv->lockStaging);
+	if (!priv->staging_open) {
+		rt_mutex_unlock(&priv->lockStaging);
+		return -EINVAL;
 	}
+	priv->staging_open = false;
 
-	pPd = piDev_g.ai8uPI + *ppos;
+	if (priv->staging->start < priv->staging->end) {
+		my_rt_mutex_lock(&piDev_g.lockPI);
+		if (test_bit(PICONTROL_DEV_FLAG_STOP_IO, &piDev_g.flags)) {
+			/* no cycle applies the outputs while the I/Os are stopped */
+			unsigned int start = priv->staging->start;
+			unsigned int end = priv->staging->end;
 
-	my_rt_mutex_lock(&piDev_g.lockPI);
-	if (copy_to_user(pBuf, pPd, nread) != 0) {
+			picontrol_apply_staging(priv);
+			picontrol_publish_image(start, end - start);
+		} else {
+			list_add_tail(&priv->commit_list, &piDev_g.listCommit);
+		}
 		rt_mutex_unlock(&piDev_g.lockPI);
-		pr_err("piControlRead: copy_to_user failed");
-		return -EFAULT;
 	}
-	rt_mutex_unlock(&piDev_g.lockPI);
-
-	*ppos += nread;
+	rt_mutex_unlock(&priv->lockStaging);
 
-	return nread;		// length read
+	return 0;
 }
 
-/*****************************************************************************/
-/*    W R I T E                                                              */
-/*****************************************************************************/
-static ssize_t piControlWrite(struct file *file, const char __user * pBuf, size_t count, loff_t * ppos)
+static int picontrol_set_watches(tpiControlInst *priv,
+				 unsigned long usr_addr)
 {
-	tpiControlInst *priv;
-	u8 *pPd;
-	size_t nwrite = count;
+	struct picontrol_watch *watches = NULL, *old_watches;
+	struct picontrol_watches args;
+	u8 *shadow = NULL, *old_shadow, *pos;
+	unsigned int len = 0;
+	int i;
 
-	if (!isRunning())
-		return -EAGAIN;
+	if (copy_from_user(&args, (const void __user *) usr_addr, sizeof(args)))
+		return -EFAULT;
 
-	priv = (tpiControlInst *) file->private_data;
+	if (args.count > PICONTROL_WATCHES_MAX)
+		return -EINVAL;
 
-	dev_dbg(priv->dev, "piControlWrite Count: %zu, Pos: %llu", count, *ppos);
+	if (args.count) {
+		watches = memdup_user(u64_to_user_ptr(args.watches),
+				      args.count * sizeof(*watches));
+		if (IS_ERR(watches))
+			return PTR_ERR(watches);
 
-	if (*ppos < 0 || *ppos >= KB_PI_LEN) {
-		return 0;	// end of file
-	}
+		for (i = 0; i < args.count; i++) {
+			if (!watches[i].len ||
+			    watches[i].addr + watches[i].len > KB_PI_LEN) {
+				kfree(watches);
+				return -EINVAL;
+			}
+			len += watches[i].len;
+		}
 
-	if (nwrite + *ppos > KB_PI_LEN) {
-		nwrite = KB_PI_LEN - *ppos;
+		shadow = kmalloc(len, GFP_KERNEL);
+		if (!shadow) {
+			kfree(watches);
+			return -ENOMEM;
+		}
 	}
 
-	pPd = piDev_g.ai8uPI + *ppos;
-
 	my_rt_mutex_lock(&piDev_g.lockPI);
-	if (copy_from_user(pPd, pBuf, nwrite) != 0) {
-		rt_mutex_unlock(&piDev_g.lockPI);
-		pr_err("piControlWrite: copy_from_user failed");
-		return -EFAULT;
-	}
+	/* start with the current content, changes are reported from now on */
+	for (i = 0, pos = shadow; i < args.count; pos += watches[i].len, i++)
+		memcpy(pos, piDev_g.ai8uPI + watches[i].addr, watches[i].len);
+
+	my_rt_mutex_lock(&piDev_g.lockWatch);
+	old_watches = priv->watches;
+	old_shadow = priv->watch_shadow;
+	priv->watches = watches;
+	priv->watch_shadow = shadow;
+	priv->num_watches = args.count;
+	memset(&priv->changes, 0, sizeof(priv->changes));
+
+	list_del_init(&priv->watch_list);
+	if (args.count)
+		list_add_tail(&priv->watch_list, &piDev_g.listWatch);
+	rt_mutex_unlock(&piDev_g.lockWatch);
 	rt_mutex_unlock(&piDev_g.lockPI);
-	*ppos += nwrite;
 
-	if (priv->tTimeoutDurationMs > 0) {
-		priv->tTimeoutTS = ktime_add_ms(ktime_get(), priv->tTimeoutDurationMs);
-	}
+	kfree(old_watches);
+	kfree(old_shadow);
 
-	return nwrite;		// length written
+	return 0;
 }
 
-/*****************************************************************************/
-/*    S E E K                                                           */
-/*****************************************************************************/
-static loff_t piControlSeek(struct file *file, loff_t off, int whence)
+static int picontrol_get_changes(tpiControlInst *priv,
+				 unsigned long usr_addr)
 {
-	tpiControlInst *priv;
-	loff_t newpos;
-
-	if (!isRunning())
-		return -EAGAIN;
-
-	priv = (tpiControlInst *) file->private_data;
-
-	switch (whence) {
-	case 0:		/* SEEK_SET */
-		newpos = off;
-		break;
-
-	case 1:		/* SEEK_CUR */
-		newpos = file->f_pos + off;
-		break;
+	struct picontrol_changes changes;
 
-	case 2:		/* SEEK_END */
-		newpos = KB_PI_LEN + off;
-		break;
-
-	default:		/* can't happen */
-		return -EINVAL;
-	}
+	my_rt_mutex_lock(&piDev_g.lockWatch);
+	changes = priv->changes;
+	memset(&priv->changes, 0, sizeof(priv->changes));
+	rt_mutex_unlock(&piDev_g.lockWatch);
 
-	if (newpos < 0 || newpos >= KB_PI_LEN)
-		return -EINVAL;
+	if (copy_to_user((void __user *) usr_addr, &changes, sizeof(changes)))
+		return -EFAULT;
 
-	file->f_pos = newpos;
-	return newpos;
+	return 0;
 }
 
 static int picontrol_upload_firmware(struct picontrol_firmware_upload *fwu,
@@ -1095,6 +2250,7 @@ static void picontrol_set_device_info(SDeviceInfo *out, SDevice *dev)
 	out->i16uConfigLength = dev->i16uConfigLength;
 	out->i16uConfigOffset = dev->i16uConfigOffset;
 	out->i8uModuleState = dev->i8uModuleState;
+	out->i8uCycleDivider = dev->i8uCycleDivider;
 }
 
 static int picontrol_get_device_info(SDeviceInfo *dev_info)
@@ -1282,6 +2438,191 @@ static int send_internal_io_telegram(void *req, unsigned int reqlen,
 	return 0;
 }
 
+/* Return the number of bytes in the process image touched by a value. */
+static int picontrol_value_len(const struct picontrol_value *val)
+{
+	int len;
+
+	switch (val->width) {
+	case 1:
+		if (val->bit >= 8)
+			return -EINVAL;
+		len = 1;
+		break;
+	case 8:
+	case 16:
+	case 32:
+		len = val->width / 8;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (val->addr + len > KB_PI_LEN)
+		return -EINVAL;
+
+	return len;
+}
+
+static struct picontrol_value *picontrol_copy_values(unsigned long usr_addr,
+						     struct picontrol_values *vals)
+{
+	if (copy_from_user(vals, (const void __user *) usr_addr, sizeof(*vals)))
+		return ERR_PTR(-EFAULT);
+
+	if (!vals->count || vals->count > PICONTROL_VALUES_MAX)
+		return ERR_PTR(-EINVAL);
+
+	return vmemdup_user(u64_to_user_ptr(vals->values),
+			    vals->count * sizeof(struct picontrol_value));
+}
+
+static int picontrol_get_values(unsigned long usr_addr)
+{
+	struct picontrol_values vals;
+	struct picontrol_value *val;
+	unsigned int seq;
+	const u8 *img;
+	int ret = 0;
+	int i, j;
+
+	if (!isRunning())
+		return -EAGAIN;
+
+	val = picontrol_copy_values(usr_addr, &vals);
+	if (IS_ERR(val))
+		return PTR_ERR(val);
+
+	do {
+		seq = picontrol_published_begin(&img);
+
+		for (i = 0; i < vals.count; i++) {
+			int len = picontrol_value_len(&val[i]);
+
+			if (len < 0) {
+				val[i].status = len;
+				continue;
+			}
+
+			val[i].status = 0;
+			val[i].value = 0;
+			if (val[i].width == 1) {
+				val[i].value = (img[val[i].addr] >> val[i].bit) & 1;
+				continue;
+			}
+
+			for (j = 0; j < len; j++)
+				val[i].value |= (u32) img[val[i].addr + j] << (8 * j);
+		}
+	} while (picontrol_published_retry(seq));
+
+	if (copy_to_user(u64_to_user_ptr(vals.values), val,
+			 vals.count * sizeof(*val)))
+		ret = -EFAULT;
+
+	kvfree(val);
+	return ret;
+}
+
+static int picontrol_set_values(tpiControlInst *priv, unsigned long usr_addr)
+{
+	unsigned int start = KB_PI_LEN;
+	struct picontrol_values vals;
+	struct picontrol_value *val;
+	struct picontrol_staging *st;
+	unsigned int end = 0;
+	int ret = 0;
+	int i, j;
+
+	if (!isRunning())
+		return -EAGAIN;
+
+	val = picontrol_copy_values(usr_addr, &vals);
+	if (IS_ERR(val))
+		return PTR_ERR(val);
+
+	st = picontrol_output_lock(priv);
+	for (i = 0; i < vals.count; i++) {
+		int len = picontrol_value_len(&val[i]);
+
+		val[i].status = len < 0 ? len : 0;
+		if (len < 0)
+			continue;
+
+		if (val[i].width == 1) {
+			picontrol_output_byte(priv, st, val[i].addr,
+					      val[i].value ? 0xff : 0,
+					      1 << val[i].bit);
+		} else {
+			for (j = 0; j < len; j++)
+				picontrol_output_byte(priv, st, val[i].addr + j,
+						      val[i].value >> (8 * j), 0xff);
+		}
+
+		start = min_t(unsigned int, start, val[i].addr);
+		end = max_t(unsigned int, end, val[i].addr + len);
+	}
+	picontrol_output_unlock(priv, st, start, end);
+
+	picontrol_watchdog_retrigger(priv);
+
+	if (copy_to_user(u64_to_user_ptr(vals.values), val,
+			 vals.count * sizeof(*val)))
+		ret = -EFAULT;
+
+	kvfree(val);
+	return ret;
+}
+
+static int find_variables(unsigned long usr_addr)
+{
+	struct picontrol_variables vars;
+	SPIVariable *var;
+	SEntryInfo *entry;
+	int found = 0;
+	int i;
+
+	if (copy_from_user(&vars, (const void __user *) usr_addr, sizeof(vars)))
+		return -EFAULT;
+
+	if (!vars.count || vars.count > PICONTROL_VARIABLES_MAX)
+		return -EINVAL;
+
+	var = vmemdup_user(u64_to_user_ptr(vars.variables),
+			   vars.count * sizeof(*var));
+	if (IS_ERR(var))
+		return PTR_ERR(var);
+
+	if (!piDev_g.ent) {
+		kvfree(var);
+		return -ENOENT;
+	}
+
+	for (i = 0; i < vars.count; i++) {
+		/* make sure we have a valid string */
+		var[i].strVarName[sizeof(var[i].strVarName) - 1] = '\0';
+
+		entry = piConfigFindEntry(piDev_g.ent, var[i].strVarName);
+		if (entry) {
+			var[i].i16uAddress = entry->i16uOffset;
+			var[i].i8uBit = entry->i8uBitPos;
+			var[i].i16uLength = entry->i16uBitLength;
+			found++;
+		} else {
+			var[i].i16uAddress = 0xffff;
+			var[i].i8uBit = 0xff;
+			var[i].i16uLength = 0xffff;
+		}
+	}
+
+	if (copy_to_user(u64_to_user_ptr(vars.variables), var,
+			 vars.count * sizeof(*var)))
+		found = -EFAULT;
+
+	kvfree(var);
+	return found;
+}
+
 static int reset_dio_counter(unsigned long usr_addr)
 {
 	SDIOResetCounter res_cnt;
@@ -1494,12 +2835,19 @@ static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long
 		pr_debug("BridgeState=%d\n", piCore_g.eBridgeState);
 
 		if (piDev_g.pibridge_supported && isRunning()) {
-			PiBridgeMaster_Stop();
+			PiBridgeMaster_Pause();
 		}
 		status = piControlReset(priv);
 		rt_mutex_unlock(&piDev_g.lockIoctl);
 		break;
 
+	case PICONTROL_RELOAD_CONFIG:
+		rt_mutex_lock(&piDev_g.lockIoctl);
+		pr_info("configuration reload requested\n");
+		status = piControlReload(priv);
+		rt_mutex_unlock(&piDev_g.lockIoctl);
+		break;
+
 	case KB_GET_DEVICE_INFO:
 		{
 			SDeviceInfo dev_info;
@@ -1580,6 +2928,8 @@ static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long
 	case KB_GET_VALUE:
 		{
 			SPIValue spi_val;
+			const u8 *img;
+			unsigned int seq;
 			u8 val;
 
 			if (!isRunning())
@@ -1594,9 +2944,10 @@ static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long
 			if (spi_val.i16uAddress >= KB_PI_LEN) {
 				status = -EINVAL;
 			} else {
-				rt_mutex_lock(&piDev_g.lockPI);
-				val = piDev_g.ai8uPI[spi_val.i16uAddress];
-				rt_mutex_unlock(&piDev_g.lockPI);
+				do {
+					seq = picontrol_published_begin(&img);
+					val = img[spi_val.i16uAddress];
+				} while (picontrol_published_retry(seq));
 
 				if (spi_val.i8uBit >= 8) {
 					spi_val.i8uValue = val;
@@ -1632,34 +2983,59 @@ static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long
 			if (spi_val.i16uAddress >= KB_PI_LEN) {
 				status = -EINVAL;
 			} else {
-				u8 i8uValue_l;
-				my_rt_mutex_lock(&piDev_g.lockPI);
-				i8uValue_l = piDev_g.ai8uPI[spi_val.i16uAddress];
-
-				if (spi_val.i8uBit >= 8) {
-					i8uValue_l = spi_val.i8uValue;
-				} else {
-					if (spi_val.i8uValue)
-						i8uValue_l |= (1 << spi_val.i8uBit);
-					else
-						i8uValue_l &= ~(1 << spi_val.i8uBit);
-				}
+				struct picontrol_staging *st;
 
-				piDev_g.ai8uPI[spi_val.i16uAddress] = i8uValue_l;
-				rt_mutex_unlock(&piDev_g.lockPI);
+				st = picontrol_output_lock(priv);
+				if (spi_val.i8uBit >= 8)
+					picontrol_output_byte(priv, st, spi_val.i16uAddress,
+							      spi_val.i8uValue, 0xff);
+				else
+					picontrol_output_byte(priv, st, spi_val.i16uAddress,
+							      spi_val.i8uValue ? 0xff : 0,
+							      1 << spi_val.i8uBit);
+				picontrol_output_unlock(priv, st, spi_val.i16uAddress,
+							spi_val.i16uAddress + 1);
 
-				if (priv->tTimeoutDurationMs > 0) {
-					priv->tTimeoutTS = ktime_add_ms(ktime_get(), priv->tTimeoutDurationMs);
-				}
+				picontrol_watchdog_retrigger(priv);
 
 				status = 0;
 			}
 		}
 		break;
 
+	case KB_GET_VALUES:
+		status = picontrol_get_values(usr_addr);
+		break;
+
+	case KB_SET_VALUES:
+		status = picontrol_set_values(priv, usr_addr);
+		break;
+
+	case KB_FIND_VARIABLES:
+		my_rt_mutex_lock(&piDev_g.lockIoctl);
+		status = find_variables(usr_addr);
+		rt_mutex_unlock(&piDev_g.lockIoctl);
+		break;
+
+	case PICONTROL_BEGIN_OUTPUTS:
+		status = picontrol_begin_outputs(priv);
+		break;
+
+	case PICONTROL_COMMIT_OUTPUTS:
+		status = picontrol_commit_outputs(priv);
+		break;
+
+	case KB_SET_WATCHES:
+		status = picontrol_set_watches(priv, usr_addr);
+		break;
+
+	case KB_GET_CHANGES:
+		status = picontrol_get_changes(priv, usr_addr);
+		break;
+
 	case KB_FIND_VARIABLE:
 		{
-			int i;
+			SEntryInfo *entry;
 			SPIVariable spi_var;
 			int namelen;
 			const char __user *usr_name;
@@ -1667,11 +3043,6 @@ static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long
 			if (!isRunning())
 				return -EAGAIN;
 
-			if (!piDev_g.ent) {
-				status = -ENOENT;
-				break;
-			}
-
 			usr_name = ((SPIVariable *) usr_addr)->strVarName;
 
 			namelen = strncpy_from_user(spi_var.strVarName, usr_name,
@@ -1687,15 +3058,21 @@ static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long
 			spi_var.i8uBit = 0xff;
 			spi_var.i16uLength = 0xffff;
 
-			for (i = 0; i < piDev_g.ent->i16uNumEntries; i++) {
-				if (strcmp(piDev_g.ent->ent[i].strVarName, spi_var.strVarName) == 0) {
-					spi_var.i16uAddress = piDev_g.ent->ent[i].i16uOffset;
-					spi_var.i8uBit = piDev_g.ent->ent[i].i8uBitPos;
-					spi_var.i16uLength = piDev_g.ent->ent[i].i16uBitLength;
-					status = 0;
-					break;
-				}
+			/* the config must not be replaced during the lookup */
+			my_rt_mutex_lock(&piDev_g.lockIoctl);
+			if (!piDev_g.ent) {
+				rt_mutex_unlock(&piDev_g.lockIoctl);
+				status = -ENOENT;
+				break;
+			}
+			entry = piConfigFindEntry(piDev_g.ent, spi_var.strVarName);
+			if (entry) {
+				spi_var.i16uAddress = entry->i16uOffset;
+				spi_var.i8uBit = entry->i8uBitPos;
+				spi_var.i16uLength = entry->i16uBitLength;
+				status = 0;
 			}
+			rt_mutex_unlock(&piDev_g.lockIoctl);
 
 			if (copy_to_user((void __user *) usr_addr, &spi_var, sizeof(spi_var))) {
 				pr_err("failed to copy spi variable to user\n");
@@ -1707,7 +3084,10 @@ static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long
 
 	case KB_SET_EXPORTED_OUTPUTS:
 		{
-			int i;
+			struct picontrol_staging *st;
+			unsigned int gen, span_addr, span_len;
+			piCopylist *cl;
+			u8 *staging;
 			ktime_t now;
 
 			if (!isRunning())
@@ -1718,49 +3098,62 @@ static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long
 				return -EINVAL;
 			}
 
-			if (piDev_g.cl == 0 || piDev_g.cl->i16uNumEntries == 0)
+exported_outputs_again:
+			my_rt_mutex_lock(&piDev_g.lockPI);
+			cl = piDev_g.cl;
+			gen = piDev_g.config_gen;
+			span_addr = cl && cl->i16uNumRuns ? cl->i16uSpanAddr : 0;
+			span_len = cl && cl->i16uNumRuns ? cl->i16uSpanLength : 0;
+			rt_mutex_unlock(&piDev_g.lockPI);
+
+			if (span_len == 0)
 				return 0;	// nothing to do
 
-			status = 0;
-			now = ktime_get();
+			/* fetch all outputs at once, without holding lockPI */
+			staging = kmalloc(span_len, GFP_KERNEL);
+			if (!staging)
+				return -ENOMEM;
 
-			my_rt_mutex_lock(&piDev_g.lockPI);
-			piDev_g.tLastOutput2 = piDev_g.tLastOutput1;
-			piDev_g.tLastOutput1 = now;
+			if (copy_from_user(staging,
+					   (void __user *) (usr_addr + span_addr),
+					   span_len)) {
+				kfree(staging);
+				return -EFAULT;
+			}
 
-			for (i = 0; i < piDev_g.cl->i16uNumEntries; i++) {
-				uint16_t len = piDev_g.cl->ent[i].i16uLength;
-				uint16_t addr = piDev_g.cl->ent[i].i16uAddr;
+			status = 0;
+			now = ktime_get();
 
-				if (len >= 8) {
-					len /= 8;
-					if (copy_from_user(piDev_g.ai8uPI + addr, (void *)(usr_addr + addr), len) != 0) {
-						status = -EFAULT;
-						break;
-					}
-				} else {
-					uint8_t val1, val2;
-					uint8_t mask = piDev_g.cl->ent[i].i8uBitMask;
+			st = picontrol_output_lock(priv);
+			if (st)
+				my_rt_mutex_lock(&piDev_g.lockPI);
 
-					if (get_user(val1, (u8 __user*) (usr_addr + addr))) {
-						pr_err("failed to copy byte from user\n");
-						status = -EFAULT;
-						break;
-					}
+			/* the config was replaced while copying the outputs */
+			if (piDev_g.config_gen != gen) {
+				if (st)
+					rt_mutex_unlock(&piDev_g.lockPI);
+				picontrol_output_unlock(priv, st, 0, 0);
+				kfree(staging);
+				goto exported_outputs_again;
+			}
 
-					val1 &= mask;
+			piDev_g.tLastOutput2 = piDev_g.tLastOutput1;
+			piDev_g.tLastOutput1 = now;
 
-					val2 = piDev_g.ai8uPI[addr];
-					val2 &= ~mask;
-					val2 |= val1;
-					piDev_g.ai8uPI[addr] = val2;
-				}
+			piCopylistMerge(cl, st ? st->data : piDev_g.ai8uPI, staging);
+			if (st || priv->wd_owned) {
+				/* merging all ones yields the masks of the copy list */
+				memset(staging, 0xff, span_len);
+				piCopylistMerge(cl, st ? st->mask : priv->wd_owned,
+						staging);
 			}
-			rt_mutex_unlock(&piDev_g.lockPI);
+			if (st)
+				rt_mutex_unlock(&piDev_g.lockPI);
+			picontrol_output_unlock(priv, st, span_addr,
+						span_addr + span_len);
+			kfree(staging);
 
-			if (priv->tTimeoutDurationMs > 0) {
-				priv->tTimeoutTS = ktime_add_ms(ktime_get(), priv->tTimeoutDurationMs);
-			}
+			picontrol_watchdog_retrigger(priv);
 		}
 		break;
 
@@ -1928,27 +3321,26 @@ static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long
 		break;
 
 	case KB_WAIT_FOR_EVENT:
-		{
-			tpiEventEntry *pEntry;
-
-			if (wait_event_interruptible(priv->wq, !list_empty(&priv->piEventList)) == 0) {
-				my_rt_mutex_lock(&priv->lockEventList);
-				pEntry = list_first_entry(&priv->piEventList, tpiEventEntry, list);
-
-				list_del(&pEntry->list);
-				rt_mutex_unlock(&priv->lockEventList);
-
-				if (put_user(pEntry->event, (u32 __user *) usr_addr)) {
-					status = -EFAULT;
-				} else {
-					status = 0;
-				}
-
-				kfree(pEntry);
+		/* only the reset is reported, see PICONTROL_GET_EVENTS */
+		if (wait_event_interruptible(priv->wq,
+				test_and_clear_bit(PICONTROL_INST_FLAG_RESET,
+						   &priv->event_flags)) == 0) {
+			if (put_user(KB_EVENT_RESET, (u32 __user *) usr_addr)) {
+				status = -EFAULT;
+			} else {
+				status = 0;
 			}
 		}
 		break;
 
+	case PICONTROL_GET_EVENTS:
+		status = picontrol_get_events(priv, file, usr_addr);
+		break;
+
+	case PICONTROL_WAIT_FOR_CYCLE:
+		status = picontrol_wait_for_cycle(priv, usr_addr);
+		break;
+
 	case KB_GET_LAST_MESSAGE:
 		{
 			if (copy_to_user((void *)usr_addr, priv->pcErrorMessage, sizeof(priv->pcErrorMessage))) {
@@ -1987,6 +3379,14 @@ static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long
 			}
 			status = test_bit(PICONTROL_DEV_FLAG_STOP_IO,
 					  &piDev_g.flags) ? 1 : 0;
+
+			/* the cycle does not apply commits queued before the stop */
+			if (status) {
+				my_rt_mutex_lock(&piDev_g.lockPI);
+				picontrol_apply_outputs();
+				picontrol_publish_image(0, KB_PI_LEN);
+				rt_mutex_unlock(&piDev_g.lockPI);
+			}
 		}
 		break;
 
@@ -2031,14 +3431,14 @@ static long piControlIoctl(struct file *file, unsigned int prg_nr, unsigned long
 
 	case KB_SET_OUTPUT_WATCHDOG:
 		{
-			if (get_user(priv->tTimeoutDurationMs,
-				     (unsigned long __user *) usr_addr)) {
+			unsigned long period;
+
+			if (get_user(period, (unsigned long __user *) usr_addr)) {
 				pr_err("failed to copy timeout from user\n");
 				return -EFAULT;
 			}
 
-			priv->tTimeoutTS = ktime_add_ms(ktime_get(), priv->tTimeoutDurationMs);
-			status = 0;
+			status = picontrol_watchdog_start(priv, period);
 		}
 		break;
 
@@ -8,7 +8,9 @@
 /********************************  Includes  **********************************/
 /******************************************************************************/
 #include <linux/cdev.h>
+#include <linux/hrtimer.h>
 #include <linux/leds.h>
+#include <linux/workqueue.h>
 
 #include "common_define.h"
 #include "piConfig.h"
@@ -16,10 +18,6 @@
 /******************************************************************************/
 /*********************************  Types  ************************************/
 /******************************************************************************/
-typedef enum piEvent {
-	piEvReset = 1,
-} enPiEvent;
-
 enum revpi_machine {
 	REVPI_CORE = 1,
 	REVPI_COMPACT = 2,
@@ -37,6 +35,20 @@ enum {
 	REVPI_PIBRIDGE_ETHERNET_GPIO_DETECT
 };
 
+/*
+ * Log-linear histogram of the cycle times in usecs: below
+ * PICONTROL_CYCLE_HIST_LINEAR every usec has its own bucket, above that every
+ * power of 2 is split into PICONTROL_CYCLE_HIST_SUB buckets. Cycles of
+ * (1 << PICONTROL_CYCLE_HIST_MAX_BITS) usecs and more share the last bucket.
+ */
+#define PICONTROL_CYCLE_HIST_SUB_BITS	3
+#define PICONTROL_CYCLE_HIST_SUB	(1 << PICONTROL_CYCLE_HIST_SUB_BITS)
+#define PICONTROL_CYCLE_HIST_LINEAR	(2 * PICONTROL_CYCLE_HIST_SUB)
+#define PICONTROL_CYCLE_HIST_MAX_BITS	20
+#define PICONTROL_CYCLE_HIST_BUCKETS	(PICONTROL_CYCLE_HIST_LINEAR + \
+	(PICONTROL_CYCLE_HIST_MAX_BITS - PICONTROL_CYCLE_HIST_SUB_BITS - 1) * \
+	PICONTROL_CYCLE_HIST_SUB)
+
 struct picontrol_cycle {
 	struct hrtimer timer;
 	struct completion timer_expired;
@@ -47,7 +59,22 @@ struct picontrol_cycle {
 	unsigned int last;
 	unsigned int max;
 	unsigned int min;
+	u64 count;	/* number of completed cycles */
+	ktime_t end;	/* end of the last completed cycle */
 	seqlock_t lock;
+	wait_queue_head_t wq;	/* woken up at the end of each cycle */
+	/* updated without a lock, see picontrol_cycle_account() */
+	atomic64_t hist[PICONTROL_CYCLE_HIST_BUCKETS];
+};
+
+/*
+ * Outputs written by a file handle between PICONTROL_BEGIN_OUTPUTS and
+ * PICONTROL_COMMIT_OUTPUTS. mask holds the written bits of each byte.
+ */
+struct picontrol_staging {
+	u8 data[KB_PI_LEN];
+	u8 mask[KB_PI_LEN];
+	unsigned int start, end;	// range with bits set in mask
 };
 
 typedef struct spiControlDev {
@@ -66,7 +93,9 @@ typedef struct spiControlDev {
 	unsigned int revpi_gate_supported:1;
 
 	// process image stuff
-	u8 ai8uPI[KB_PI_LEN];
+	u8 *ai8uPI;		// page allocated, can be mapped to userspace
+	struct picontrol_mmap_status *mmap_status;
+	u8 *pi_published;	// two copies of ai8uPI, one page each
 	u8 ai8uPIDefault[KB_PI_LEN];
 	struct rt_mutex lockPI;
 #define PICONTROL_DEV_FLAG_STOP_IO		0
@@ -79,11 +108,18 @@ typedef struct spiControlDev {
 	   execution of ioctls. This is especially needed during reset. */
 	struct rt_mutex lockIoctl;
 	piConnectionList *connl;
+	piConnectionProgram *connp;	// compiled connl, protected by lockPI
+	unsigned int config_gen;	// bumped on every config change, lockPI
 	ktime_t tLastOutput1, tLastOutput2;
 
 	// handle open connections and notification
 	struct list_head listCon;
 	struct rt_mutex lockListCon;
+	// instances watching the process image for changes
+	struct list_head listWatch;
+	struct rt_mutex lockWatch;	// taken after lockPI
+	// instances with committed outputs, protected by lockPI
+	struct list_head listCommit;
 
 	struct led_trigger power_red;
 	struct led_trigger a1_green;
@@ -108,26 +144,103 @@ typedef struct spiControlDev {
 	bool pibridge_mode_ethernet_right;
 	/* PiControl cycle attributes */
 	struct picontrol_cycle cycle;
+	struct dentry *debugfs;	// piControl directory in debugfs
 } tpiControlDev;
 
-typedef struct spiEventEntry {
-	enum piEvent event;
-	struct list_head list;
-} tpiEventEntry;
+#define PICONTROL_EVENT_RING_SIZE	32	// must be a power of 2
+
+/*
+ * Bounded queue of events for one file handle. Every slot has a sequence
+ * number which tells producers and consumers if the slot is free or filled
+ * for their position, so events are queued without locks or allocations.
+ */
+struct picontrol_event_ring {
+	atomic_t head;		// next position to fill
+	atomic_t tail;		// next position to consume
+	atomic_t lost;		// events dropped because the ring was full
+	struct {
+		atomic_t seq;
+		struct picontrol_event ev;
+	} slot[PICONTROL_EVENT_RING_SIZE];
+};
 
 typedef struct spiControlInst {
 	struct device *dev;
 	wait_queue_head_t wq;
-	struct list_head piEventList;	// head of the event list for this instance
-	struct rt_mutex lockEventList;
+	struct picontrol_event_ring events;	// used after PICONTROL_GET_EVENTS
+#define PICONTROL_INST_FLAG_RESET		0	// KB_EVENT_RESET pending
+#define PICONTROL_INST_FLAG_GET_EVENTS		1	// queue all events
+	unsigned long event_flags;
+	struct picontrol_event reset_event;	// protected by lockListCon
 	struct list_head list;	// list of all instances
-	ktime_t tTimeoutTS;	// time stamp when the output must be set to 0
+	atomic64_t tTimeoutTS;	// time stamp when the output must be set to 0
 	unsigned long tTimeoutDurationMs;	// length of the timeout in ms, 0 if not active
+	struct hrtimer wd_timer;	// expires at tTimeoutTS
+	struct work_struct wd_work;	// sets the outputs to 0
+	u8 *wd_owned;		// bits written by this instance, NULL: all outputs
+	u64 last_cycle;		// last cycle reported by PICONTROL_WAIT_FOR_CYCLE
+	// ranges of the process image watched for changes, see KB_SET_WATCHES
+	struct list_head watch_list;	// entry in listWatch if num_watches > 0
+	struct picontrol_watch *watches;
+	unsigned int num_watches;
+	u8 *watch_shadow;	// last seen content of the watched ranges
+	struct picontrol_changes changes;	// not yet fetched changes
+	// output transaction, see PICONTROL_BEGIN_OUTPUTS
+	struct rt_mutex lockStaging;	// taken before lockPI
+	struct picontrol_staging *staging;
+	bool staging_open;	// outputs are written to staging
+	struct list_head commit_list;	// entry in listCommit until applied
 	char pcErrorMessage[REV_PI_ERROR_MSG_LEN];	// error message of last ioctl call
 } tpiControlInst;
 
 extern tpiControlDev piDev_g;
 
+/*
+ * Mark the begin and the end of an update of input data in the process
+ * image, so that applications which mmap() the process image can detect
+ * torn reads (see struct picontrol_mmap_status). Must be called with
+ * lockPI held.
+ */
+static inline void picontrol_image_write_begin(void)
+{
+	struct picontrol_mmap_status *status = piDev_g.mmap_status;
+
+	WRITE_ONCE(status->seq, status->seq + 1);
+	smp_wmb();
+}
+
+static inline void picontrol_image_write_end(void)
+{
+	struct picontrol_mmap_status *status = piDev_g.mmap_status;
+
+	smp_wmb();
+	WRITE_ONCE(status->seq, status->seq + 1);
+}
+
+/*
+ * Readers of the published process image do not take lockPI. They read the
+ * stable one of the two copies and retry if it was changed in the meantime:
+ *
+ *	do {
+ *		seq = picontrol_published_begin(&img);
+ *		... read from img ...
+ *	} while (picontrol_published_retry(seq));
+ */
+static inline unsigned int picontrol_published_begin(const u8 **img)
+{
+	unsigned int seq = READ_ONCE(piDev_g.mmap_status->published_seq);
+
+	smp_rmb();
+	*img = piDev_g.pi_published + (seq & 1) * PAGE_SIZE;
+	return seq;
+}
+
+static inline bool picontrol_published_retry(unsigned int seq)
+{
+	smp_rmb();
+	return READ_ONCE(piDev_g.mmap_status->published_seq) != seq;
+}
+
 /******************************************************************************/
 /*******************************  Prototypes  *********************************/
 /******************************************************************************/
@@ -135,5 +248,12 @@ extern tpiControlDev piDev_g;
 bool isRunning(void);
 void printUserMsg(tpiControlInst *priv, const char *s, ...);
 unsigned int piControl_get_cycle_duration(void);
+void picontrol_publish_image(unsigned int offset, unsigned int len);
+void picontrol_publish_cycle(void);
+void picontrol_cycle_completed(void);
+void picontrol_cycle_account(unsigned int usecs);
+void picontrol_run_connections(void);
+void picontrol_apply_outputs(void);
+void picontrol_post_event(tpiControlInst *except, u32 type, u32 arg);
 
 #endif /* PRODUCTS_PIBASE_PIKERNELMOD_PICONTROLINTERN_H_ */
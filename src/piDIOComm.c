@@ -5,6 +5,7 @@
 
 #include "piDIOComm.h"
 #include "common_define.h"
+#include "revpi_common.h"
 #include "revpi_core.h"
 
 #define DIO_OUTPUT_DATA_LEN		18
@@ -15,10 +16,14 @@ static u8 i8uConfigured_s = 0;
 static SDioConfig dioConfig_s[10];
 static u8 i8uNumCounter[64];
 static u16 i16uCounterAct[64];
+/* outputs last acknowledged by each module, indexed by address */
+static u8 last_out_s[40][DIO_OUTPUT_DATA_LEN];
 
 void piDIOComm_InitStart(void)
 {
 	i8uConfigured_s = 0;
+	/* the modules start with all outputs and PWM values at 0 */
+	memset(last_out_s, 0, sizeof(last_out_s));
 }
 
 u32 piDIOComm_Config(uint8_t i8uAddress, uint16_t i16uNumEntries, SEntryInfo * pEnt)
@@ -95,6 +100,8 @@ u32 piDIOComm_Init(u8 i8uDevice_p)
 			ret = pibridge_req_io(piCore_g.pibridge, addr,
 					      IOP_TYP1_CMD_CFG, snd_buf,
 					      snd_len, NULL, 0);
+			/* send all outputs again, see RevPiDevice_recover() */
+			memset(last_out_s[addr], 0, sizeof(last_out_s[addr]));
 			break;
 		}
 	}
@@ -104,11 +111,11 @@ u32 piDIOComm_Init(u8 i8uDevice_p)
 
 u32 piDIOComm_sendCyclicTelegram(u8 devnum)
 {
-	static u8 last_out[40][DIO_OUTPUT_DATA_LEN];
 	u8 in_buf[IOPROTOCOL_MAXDATA_LENGTH];
 	u8 out_buf[DIO_OUTPUT_DATA_LEN];
 	/* out_buf and additional 2 bytes for calculated channel mask */
 	u8 snd_buf[DIO_PWM_DATA_LEN];
+	unsigned long changed;
 	SDevice *revpi_dev;
 	u8 data_in[70];
 	u8 snd_len;
@@ -136,7 +143,8 @@ u32 piDIOComm_sendCyclicTelegram(u8 devnum)
 	}
 
 	/* check if any PWM values have changed since last cycle */
-	if (!memcmp(out_buf + 2, last_out[addr] + 2, DIO_OUTPUT_DATA_LEN - 2)) {
+	changed = revpi_delta_changed(last_out_s[addr] + 2, out_buf + 2, 16, 1);
+	if (!changed) {
 		// only the direct output pins have changed
 		snd_len = sizeof(u16);
 		cmd = IOP_TYP1_CMD_DATA;
@@ -146,25 +154,15 @@ u32 piDIOComm_sendCyclicTelegram(u8 devnum)
 
 		memcpy(&pwm->output, out_buf, sizeof(u16));
 		// copy all PWM values that have changed
-		pwm->channels = 0;
-		j = 0;
-		for (i = 0; i < 16; i++) {
-			if (last_out[addr][i + 2] != out_buf[i + 2]) {
-				pwm->channels |= 1 << i;
-				pwm->value[j] = out_buf[i + 2];
-				j++;
-			}
-		}
-		snd_len = j + 4;
+		pwm->channels = changed;
+		snd_len = revpi_delta_pack(pwm->value, out_buf + 2, changed, 1) + 4;
 		cmd = IOP_TYP1_CMD_DATA2;
 	}
 
-	memcpy(last_out[addr], out_buf, sizeof(out_buf));
-
 	rcv_len = 3 * sizeof(u16) + i8uNumCounter[addr] * sizeof(u32);
 
-	ret = pibridge_req_io(piCore_g.pibridge, addr, cmd, snd_buf, snd_len,
-			      in_buf, rcv_len);
+	ret = RevPiDevice_req_io(revpi_dev, cmd, snd_buf, snd_len, in_buf,
+				 rcv_len);
 	if (ret != rcv_len) {
 		pr_debug("DIO addr %2d: communication failed (req:%u,ret:%d)\n",
 			addr, rcv_len, ret);
@@ -175,6 +173,9 @@ u32 piDIOComm_sendCyclicTelegram(u8 devnum)
 		return ret;
 	}
 
+	/* PWM values of a lost telegram are sent again in the next cycle */
+	memcpy(last_out_s[addr], out_buf, sizeof(out_buf));
+
 	memcpy(&data_in[0], in_buf, 3 * sizeof(u16));
 	memset(&data_in[6], 0, 64);
 
@@ -190,8 +191,10 @@ u32 piDIOComm_sendCyclicTelegram(u8 devnum)
 
 	if (!test_bit(PICONTROL_DEV_FLAG_STOP_IO, &piDev_g.flags)) {
 		rt_mutex_lock(&piDev_g.lockPI);
+		picontrol_image_write_begin();
 		memcpy(piDev_g.ai8uPI + revpi_dev->i16uInputOffset, data_in,
 		       sizeof(data_in));
+		picontrol_image_write_end();
 		rt_mutex_unlock(&piDev_g.lockPI);
 	}
 
@@ -11,6 +11,7 @@
 #include <linux/types.h>
 
 #define PICONFIG_FILE					"/etc/revpi/config.rsc"
+#define PICONFIG_IMAGE_FILE				"/etc/revpi/config.rsc.bin"
 /* address of first module on the right side of the RevPi Core */
 #define REV_PI_DEV_FIRST_RIGHT				32
 #define PICONTROL_FIRMWARE_FORCE_UPLOAD			0x0001
@@ -41,6 +41,9 @@ static inline void cycletimer_sleep(struct cycletimer *ct,
 		stats->lost_cycles += (missed_cycles - 1);
 		write_sequnlock(&stats->lock);
 
+		picontrol_post_event(NULL, KB_EVENT_CYCLE_OVERRUN,
+				     missed_cycles - 1);
+
 		if (missed_cycles > REVPI_COMPACT_WARN_MISSED_CYCLES) {
 			pr_warn("%s: missed %lld cycles\n", current->comm,
 				missed_cycles - 1);
@@ -101,7 +104,11 @@ static __always_inline int test_bit_in_byte(u8 nr, u8 * addr)
 		if (((typeof(shadow))(piDev_g.ai8uPI + (offset))) == 0 || (shadow) == 0) \
 			pr_err("NULL pointer: %p %p\n", ((typeof(shadow))(piDev_g.ai8uPI + (offset))), (shadow)); \
 		my_rt_mutex_lock(&piDev_g.lockPI);					\
+		picontrol_image_write_begin();						\
 		((typeof(shadow))(piDev_g.ai8uPI + (offset)))->drv = (shadow)->drv;	\
+		picontrol_image_write_end();						\
+		picontrol_apply_outputs();						\
+		picontrol_run_connections();						\
 		(shadow)->usr = ((typeof(shadow))(piDev_g.ai8uPI + (offset)))->usr;	\
 		rt_mutex_unlock(&piDev_g.lockPI);					\
 	}										\
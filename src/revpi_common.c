@@ -3,8 +3,10 @@
 
 // revpi_common.c - common routines for RevPi machines
 
+#include <linux/cpumask.h>
 #include <linux/kthread.h>
 #include <linux/leds.h>
+#include <linux/module.h>
 #include <linux/sched.h>
 #include <linux/types.h>
 
@@ -159,39 +161,6 @@ void revpi_power_led_red_set(enum revpi_power_led_mode mode)
 	power_led_mode_s = mode;
 }
 
-
-void revpi_check_timeout(void)
-{
-	ktime_t now = ktime_get();
-	struct list_head *pCon;
-
-	my_rt_mutex_lock(&piDev_g.lockListCon);
-	list_for_each(pCon, &piDev_g.listCon) {
-		tpiControlInst *pos_inst;
-		pos_inst = list_entry(pCon, tpiControlInst, list);
-
-		if (pos_inst->tTimeoutDurationMs != 0) {
-			if (ktime_compare(now, pos_inst->tTimeoutTS) > 0) {
-				// set all outputs to 0
-				int i;
-				my_rt_mutex_lock(&piDev_g.lockPI);
-				for (i = 0; i < RevPiDevice_getDevCnt(); i++) {
-					if (RevPiDevice_getDev(i)->i8uActive) {
-						memset(piDev_g.ai8uPI + RevPiDevice_getDev(i)->i16uOutputOffset, 0, RevPiDevice_getDev(i)->sId.i16uFBS_OutputLength);
-					}
-				}
-				rt_mutex_unlock(&piDev_g.lockPI);
-				pos_inst->tTimeoutTS = ktime_add_ms(ktime_get(), pos_inst->tTimeoutDurationMs);
-
-				// this must only be done for one connection
-				rt_mutex_unlock(&piDev_g.lockListCon);
-				return;
-			}
-		}
-	}
-	rt_mutex_unlock(&piDev_g.lockListCon);
-}
-
 void revpi_power_led_red_run(void)
 {
 	switch (power_led_mode_s) {
@@ -286,3 +255,236 @@ out:
 	read_unlock(&tasklist_lock);
 	return ret;
 }
+
+static int picontrol_io_prio = -1;
+module_param(picontrol_io_prio, int, S_IRUSR);
+MODULE_PARM_DESC(picontrol_io_prio, "SCHED_FIFO priority of the I/O cycle thread, "
+				    "-1 for the default of the machine.");
+
+static char *picontrol_io_cpus;
+module_param(picontrol_io_cpus, charp, S_IRUSR);
+MODULE_PARM_DESC(picontrol_io_cpus, "List of cpus for the I/O cycle thread, e.g. \"3\".");
+
+static int picontrol_ain_prio = -1;
+module_param(picontrol_ain_prio, int, S_IRUSR);
+MODULE_PARM_DESC(picontrol_ain_prio, "SCHED_FIFO priority of the analog input thread "
+				     "(Compact, Flat), -1 for the default.");
+
+static char *picontrol_ain_cpus;
+module_param(picontrol_ain_cpus, charp, S_IRUSR);
+MODULE_PARM_DESC(picontrol_ain_cpus, "List of cpus for the analog input thread.");
+
+static int picontrol_gate_prio = -1;
+module_param(picontrol_gate_prio, int, S_IRUSR);
+MODULE_PARM_DESC(picontrol_gate_prio, "SCHED_FIFO priority of the gateway receive "
+				      "thread, -1 for the default.");
+
+static char *picontrol_gate_cpus;
+module_param(picontrol_gate_cpus, charp, S_IRUSR);
+MODULE_PARM_DESC(picontrol_gate_cpus, "List of cpus for the gateway receive thread.");
+
+struct revpi_thread {
+	struct task_struct *task;	// NULL if not running
+	int prio;		// -1: default_prio
+	int default_prio;
+	struct cpumask cpus;	// empty: all cpus
+};
+
+static struct revpi_thread revpi_threads[REVPI_THREAD_CNT];
+// protects the tasks in revpi_threads against concurrent changes from sysfs
+static DEFINE_RT_MUTEX(revpi_threads_lock);
+
+/* SCHED_FIFO priorities start at 1, -1 selects the default */
+static bool revpi_thread_prio_valid(int prio)
+{
+	return prio == -1 || (prio >= 1 && prio <= MAX_RT_PRIO - 1);
+}
+
+static int revpi_thread_apply(struct revpi_thread *th)
+{
+	int prio = th->prio >= 0 ? th->prio : th->default_prio;
+	int ret;
+
+	ret = set_rt_priority(th->task, prio);
+	if (ret)
+		return ret;
+
+	if (cpumask_empty(&th->cpus))
+		return set_cpus_allowed_ptr(th->task, cpu_possible_mask);
+
+	return set_cpus_allowed_ptr(th->task, &th->cpus);
+}
+
+/* Take over the module parameters, called once at probe. */
+void revpi_threads_init(void)
+{
+	const int prios[REVPI_THREAD_CNT] = {
+		picontrol_io_prio, picontrol_ain_prio, picontrol_gate_prio
+	};
+	const char *cpus[REVPI_THREAD_CNT] = {
+		picontrol_io_cpus, picontrol_ain_cpus, picontrol_gate_cpus
+	};
+	struct revpi_thread *th;
+	int i;
+
+	for (i = 0; i < REVPI_THREAD_CNT; i++) {
+		th = &revpi_threads[i];
+		th->prio = prios[i];
+		if (!revpi_thread_prio_valid(th->prio)) {
+			pr_err("invalid priority %d, using the default\n", th->prio);
+			th->prio = -1;
+		}
+		cpumask_clear(&th->cpus);
+		if (cpus[i] && cpulist_parse(cpus[i], &th->cpus)) {
+			pr_err("invalid cpu list '%s', using all cpus\n", cpus[i]);
+			cpumask_clear(&th->cpus);
+		}
+		cpumask_and(&th->cpus, &th->cpus, cpu_possible_mask);
+	}
+}
+
+/*
+ * Apply the configured priority and cpus to a newly created thread. Must be
+ * undone with revpi_thread_unregister() before the thread is stopped.
+ */
+int revpi_thread_register(enum revpi_thread_id id, struct task_struct *task,
+			  int default_prio)
+{
+	struct revpi_thread *th = &revpi_threads[id];
+	int ret;
+
+	my_rt_mutex_lock(&revpi_threads_lock);
+	th->task = task;
+	th->default_prio = default_prio;
+	ret = revpi_thread_apply(th);
+	if (ret)
+		th->task = NULL;
+	rt_mutex_unlock(&revpi_threads_lock);
+
+	return ret;
+}
+
+void revpi_thread_unregister(enum revpi_thread_id id)
+{
+	my_rt_mutex_lock(&revpi_threads_lock);
+	revpi_threads[id].task = NULL;
+	rt_mutex_unlock(&revpi_threads_lock);
+}
+
+/* Return the priority in effect, -1 if the thread is not running. */
+int revpi_thread_get_prio(enum revpi_thread_id id)
+{
+	struct revpi_thread *th = &revpi_threads[id];
+	int prio = -1;
+
+	my_rt_mutex_lock(&revpi_threads_lock);
+	if (th->task)
+		prio = th->prio >= 0 ? th->prio : th->default_prio;
+	rt_mutex_unlock(&revpi_threads_lock);
+
+	return prio;
+}
+
+/*
+ * Set the priority, -1 restores the default of the machine. The priority is
+ * only kept if it could be applied to the running thread.
+ */
+int revpi_thread_set_prio(enum revpi_thread_id id, int prio)
+{
+	struct revpi_thread *th = &revpi_threads[id];
+	int old_prio;
+	int ret = 0;
+
+	if (!revpi_thread_prio_valid(prio))
+		return -EINVAL;
+
+	my_rt_mutex_lock(&revpi_threads_lock);
+	old_prio = th->prio;
+	th->prio = prio;
+	if (th->task) {
+		ret = revpi_thread_apply(th);
+		if (ret) {
+			th->prio = old_prio;
+			revpi_thread_apply(th);
+		}
+	}
+	rt_mutex_unlock(&revpi_threads_lock);
+
+	return ret;
+}
+
+/* An empty mask means that the thread may run on all cpus. */
+void revpi_thread_get_cpus(enum revpi_thread_id id, struct cpumask *cpus)
+{
+	my_rt_mutex_lock(&revpi_threads_lock);
+	cpumask_copy(cpus, &revpi_threads[id].cpus);
+	rt_mutex_unlock(&revpi_threads_lock);
+}
+
+int revpi_thread_set_cpus(enum revpi_thread_id id, const struct cpumask *cpus)
+{
+	struct revpi_thread *th = &revpi_threads[id];
+	int ret = 0;
+
+	if (!cpumask_subset(cpus, cpu_possible_mask))
+		return -EINVAL;
+
+	my_rt_mutex_lock(&revpi_threads_lock);
+	cpumask_copy(&th->cpus, cpus);
+	if (th->task)
+		ret = revpi_thread_apply(th);
+	rt_mutex_unlock(&revpi_threads_lock);
+
+	return ret;
+}
+
+/**
+ * revpi_delta_changed - find the output channels which have to be sent
+ * @last: channel values last acknowledged by the module
+ * @cur: current channel values
+ * @count: number of channels, at most BITS_PER_LONG
+ * @size: number of bytes of one channel
+ *
+ * Modules which accept a channel mask in their cyclic request only need the
+ * channels whose value differs from the one they already have. Callers
+ * update @last after the telegram has been sent successfully, so a lost
+ * telegram is repeated in the next cycle.
+ *
+ * Return a bitmap with a bit set for each changed channel.
+ */
+unsigned long revpi_delta_changed(const void *last, const void *cur,
+				  unsigned int count, unsigned int size)
+{
+	const u8 *l = last, *c = cur;
+	unsigned long changed = 0;
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		if (memcmp(l + i * size, c + i * size, size))
+			__set_bit(i, &changed);
+	}
+	return changed;
+}
+
+/**
+ * revpi_delta_pack - copy the changed channels into a telegram
+ * @dst: payload of the telegram
+ * @src: current channel values
+ * @changed: bitmap returned by revpi_delta_changed()
+ * @size: number of bytes of one channel
+ *
+ * Return the number of channels copied to @dst.
+ */
+unsigned int revpi_delta_pack(void *dst, const void *src,
+			      unsigned long changed, unsigned int size)
+{
+	const u8 *s = src;
+	u8 *d = dst;
+	unsigned int i;
+
+	for_each_set_bit(i, &changed, BITS_PER_LONG) {
+		memcpy(d, s + i * size, size);
+		d += size;
+	}
+	return (d - (u8 *)dst) / size;
+}
@@ -5,6 +5,7 @@
 #ifndef _REVPI_COMMON_H
 #define _REVPI_COMMON_H
 
+#include <linux/cpumask.h>
 #include <linux/sched.h>
 #include <linux/sched/task.h>
 #include <linux/version.h>
@@ -22,7 +23,6 @@ void revpi_rgb_led_trigger_event(u16 led_prev, u16 led);
 void revpi_led_trigger_event(u16 led_prev, u16 led);
 void revpi_power_led_red_set(enum revpi_power_led_mode mode);
 void revpi_power_led_red_run(void);
-void revpi_check_timeout(void);
 
 extern char *lock_file;
 extern int lock_line;
@@ -52,4 +52,26 @@ struct kthread_prio {
 
 int set_kthread_prios(const struct kthread_prio *ktprios);
 int set_rt_priority(struct task_struct *task, int priority);
+
+/* threads of piControl with configurable priority and cpu affinity */
+enum revpi_thread_id {
+	REVPI_THREAD_IO,	// cycle thread: piControl I/O, Compact i/o, Flat dout
+	REVPI_THREAD_AIN,	// analog inputs of Compact and Flat
+	REVPI_THREAD_GATE,	// revpi_gate_rcv
+	REVPI_THREAD_CNT
+};
+
+void revpi_threads_init(void);
+int revpi_thread_register(enum revpi_thread_id id, struct task_struct *task,
+			  int default_prio);
+void revpi_thread_unregister(enum revpi_thread_id id);
+int revpi_thread_get_prio(enum revpi_thread_id id);
+int revpi_thread_set_prio(enum revpi_thread_id id, int prio);
+void revpi_thread_get_cpus(enum revpi_thread_id id, struct cpumask *cpus);
+int revpi_thread_set_cpus(enum revpi_thread_id id, const struct cpumask *cpus);
+
+unsigned long revpi_delta_changed(const void *last, const void *cur,
+				  unsigned int count, unsigned int size);
+unsigned int revpi_delta_pack(void *dst, const void *src,
+			      unsigned long changed, unsigned int size);
 #endif /* _REVPI_COMMON_H */
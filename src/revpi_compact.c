@@ -132,6 +132,7 @@ static int revpi_compact_poll_io(void *data)
 	SRevPiCompactImage *image = &machine->image;
 	SRevPiCompactImage prev = { };
 	struct cycletimer ct;
+	ktime_t last = 0, now;
 	int ret, i;
 	DECLARE_BITMAP(val, 8);
 	bool err;
@@ -172,7 +173,13 @@ static int revpi_compact_poll_io(void *data)
 
 		MEASSURE(2);
 		flip_process_image(image, machine->config.offset);
-		revpi_check_timeout();
+		picontrol_publish_cycle();
+		picontrol_cycle_completed();
+
+		now = ktime_get();
+		if (last)
+			picontrol_cycle_account(ktime_us_delta(now, last));
+		last = now;
 
 		MEASSURE(3);
 		/* write dout on every cycle to feed watchdog */
@@ -637,7 +644,8 @@ int revpi_compact_probe(struct platform_device *pdev)
 		goto err_release_aout1;
 	}
 
-	ret = set_rt_priority(machine->io_thread, IO_THREAD_PRIO);
+	ret = revpi_thread_register(REVPI_THREAD_IO, machine->io_thread,
+				    IO_THREAD_PRIO);
 	if (ret) {
 		pr_err("cannot upgrade i/o thread priority\n");
 		goto err_stop_io_thread;
@@ -651,7 +659,8 @@ int revpi_compact_probe(struct platform_device *pdev)
 		goto err_stop_io_thread;
 	}
 
-	ret = set_rt_priority(machine->ain_thread, AIN_THREAD_PRIO);
+	ret = revpi_thread_register(REVPI_THREAD_AIN, machine->ain_thread,
+				    AIN_THREAD_PRIO);
 	if (ret) {
 		pr_err("cannot upgrade ain thread priority\n");
 		goto err_stop_ain_thread;
@@ -675,8 +684,10 @@ int revpi_compact_probe(struct platform_device *pdev)
 	return 0;
 
 err_stop_ain_thread:
+	revpi_thread_unregister(REVPI_THREAD_AIN);
 	kthread_stop(machine->ain_thread);
 err_stop_io_thread:
+	revpi_thread_unregister(REVPI_THREAD_IO);
 	kthread_stop(machine->io_thread);
 err_release_aout1:
 	iio_channel_release(machine->aout[1]);
@@ -711,6 +722,8 @@ void revpi_compact_remove(struct platform_device *pdev)
 
 	device_remove_file(piDev_g.dev, &dev_attr_lost_cycles);
 
+	revpi_thread_unregister(REVPI_THREAD_AIN);
+	revpi_thread_unregister(REVPI_THREAD_IO);
 	if (!IS_ERR_OR_NULL(machine->ain_thread))
 		kthread_stop(machine->ain_thread);
 	if (!IS_ERR_OR_NULL(machine->io_thread))
@@ -739,9 +752,11 @@ int revpi_compact_reset(void)
 	/* disallow access to process image while offsets are changed */
 	my_rt_mutex_lock(&piDev_g.lockPI);
 	revpi_compact_adjust_config();
+	picontrol_image_write_begin();
 	memset(&image->usr, 0, sizeof(image->usr));
 	if (piDev_g.ent)
 		revpi_set_defaults(piDev_g.ai8uPI, piDev_g.ent);
+	picontrol_image_write_end();
 	rt_mutex_unlock(&piDev_g.lockPI);
 
 	machine->config = revpi_compact_config_g;
@@ -147,6 +147,12 @@ static int piIoThread(void *data)
 	while (!kthread_should_stop()) {
 		trace_picontrol_cycle_start(piCore_g.cycle_num);
 
+		if (!test_bit(PICONTROL_DEV_FLAG_STOP_IO, &piDev_g.flags)) {
+			my_rt_mutex_lock(&piDev_g.lockPI);
+			picontrol_apply_outputs();
+			rt_mutex_unlock(&piDev_g.lockPI);
+		}
+
 		if (PiBridgeMaster_Run() < 0)
 			break;
 
@@ -162,7 +168,6 @@ static int piIoThread(void *data)
 			tDiff = ktime_to_ns(ktime_sub(piDev_g.tLastOutput1, piDev_g.tLastOutput2));
 			tDiff = tDiff << 1;	// multiply by 2
 			if (ktime_to_ns(ktime_sub(now, piDev_g.tLastOutput1)) > tDiff && isRunning()) {
-				int i;
 				// the outputs were not written by logiCAD for more than twice the normal period
 				// the logiRTS must have been stopped or crashed
 				// -> set all outputs to 0
@@ -170,22 +175,7 @@ static int piIoThread(void *data)
 				if (!test_bit(PICONTROL_DEV_FLAG_STOP_IO,
 					&piDev_g.flags)) {
 					my_rt_mutex_lock(&piDev_g.lockPI);
-					for (i = 0; i < piDev_g.cl->i16uNumEntries; i++) {
-						uint16_t len = piDev_g.cl->ent[i].i16uLength;
-						uint16_t addr = piDev_g.cl->ent[i].i16uAddr;
-
-						if (len >= 8) {
-							len /= 8;
-							memset(piDev_g.ai8uPI + addr, 0, len);
-						} else {
-							uint8_t val;
-							uint8_t mask = piDev_g.cl->ent[i].i8uBitMask;
-
-							val = piDev_g.ai8uPI[addr];
-							val &= ~mask;
-							piDev_g.ai8uPI[addr] = val;
-						}
-					}
+					piCopylistClear(piDev_g.cl, piDev_g.ai8uPI);
 					rt_mutex_unlock(&piDev_g.lockPI);
 				}
 				piDev_g.tLastOutput1 = ktime_set(0, 0);
@@ -193,7 +183,13 @@ static int piIoThread(void *data)
 			}
 		}
 
-		revpi_check_timeout();
+		if (!test_bit(PICONTROL_DEV_FLAG_STOP_IO, &piDev_g.flags)) {
+			my_rt_mutex_lock(&piDev_g.lockPI);
+			picontrol_run_connections();
+			rt_mutex_unlock(&piDev_g.lockPI);
+		}
+
+		picontrol_publish_cycle();
 
 		cycle_duration = ns_to_ktime(piControl_get_cycle_duration() *
 					     NSEC_PER_USEC);
@@ -239,8 +235,17 @@ static int piIoThread(void *data)
 
 			write_sequnlock(&cycle->lock);
 
+			picontrol_cycle_account(last_cycle);
+
+			if (needed_cycles > 1 &&
+			    cycle->duration != PICONTROL_CYCLE_MIN_DURATION)
+				picontrol_post_event(NULL, KB_EVENT_CYCLE_OVERRUN,
+						     needed_cycles - 1);
+
 			trace_picontrol_cycle_end(piCore_g.cycle_num, last_cycle);
 			piCore_g.cycle_num++;
+
+			picontrol_cycle_completed();
 		}
 
 		reinit_completion(&cycle->timer_expired);
@@ -514,7 +519,8 @@ int revpi_core_probe(struct platform_device *pdev)
 		ret = PTR_ERR(piCore_g.pIoThread);
 		goto err_deinit_gpios;
 	}
-	ret = set_rt_priority(piCore_g.pIoThread, RT_PRIO_BRIDGE);
+	ret = revpi_thread_register(REVPI_THREAD_IO, piCore_g.pIoThread,
+				    RT_PRIO_BRIDGE);
 	if (ret) {
 		pr_err("cannot set rt prio of io thread\n");
 		goto err_stop_io_thread;
@@ -532,6 +538,7 @@ err_deinit_gpios:
 
 void revpi_core_remove(struct platform_device *pdev)
 {
+	revpi_thread_unregister(REVPI_THREAD_IO);
 	kthread_stop(piCore_g.pIoThread);
 	deinit_gpios();
 }
@@ -90,6 +90,7 @@ static int revpi_flat_poll_dout(void *data)
 	struct revpi_flat *flat = (struct revpi_flat *) data;
 	struct revpi_flat_image *image = &flat->image;
 	struct revpi_flat_image *usr_image;
+	ktime_t last = 0, now;
 	int dout_val = -1;
 	int aout_val = -1;
 	int raw_out;
@@ -98,7 +99,11 @@ static int revpi_flat_poll_dout(void *data)
 	while (!kthread_should_stop()) {
 		my_rt_mutex_lock(&piDev_g.lockPI);
 		image->drv.button = gpiod_get_value_cansleep(flat->button_desc);
+		picontrol_image_write_begin();
 		usr_image->drv = image->drv;
+		picontrol_image_write_end();
+		picontrol_apply_outputs();
+		picontrol_run_connections();
 
 		if (usr_image->usr.dout != image->usr.dout)
 			dout_val = usr_image->usr.dout;
@@ -107,8 +112,16 @@ static int revpi_flat_poll_dout(void *data)
 			aout_val = usr_image->usr.aout;
 
 		image->usr = usr_image->usr;
+		picontrol_publish_image(0, KB_PI_LEN);
 		rt_mutex_unlock(&piDev_g.lockPI);
 
+		picontrol_cycle_completed();
+
+		now = ktime_get();
+		if (last)
+			picontrol_cycle_account(ktime_us_delta(now, last));
+		last = now;
+
 		if (dout_val != -1) {
 			gpiod_set_value_cansleep(flat->digout, !!dout_val);
 			dout_val = -1;
@@ -280,9 +293,11 @@ static void revpi_flat_adjust_config(void)
 static void revpi_flat_set_defaults(void)
 {
 	my_rt_mutex_lock(&piDev_g.lockPI);
-	memset(piDev_g.ai8uPI, 0, sizeof(piDev_g.ai8uPI));
+	picontrol_image_write_begin();
+	memset(piDev_g.ai8uPI, 0, KB_PI_LEN);
 	if (piDev_g.ent)
 		revpi_set_defaults(piDev_g.ai8uPI, piDev_g.ent);
+	picontrol_image_write_end();
 	rt_mutex_unlock(&piDev_g.lockPI);
 }
 
@@ -370,7 +385,8 @@ int revpi_flat_probe(struct platform_device *pdev)
 		goto err_put_aout;
 	}
 
-	ret = set_rt_priority(flat->dout_thread, REVPI_FLAT_DOUT_THREAD_PRIO);
+	ret = revpi_thread_register(REVPI_THREAD_IO, flat->dout_thread,
+				    REVPI_FLAT_DOUT_THREAD_PRIO);
 	if (ret) {
 		dev_err(piDev_g.dev, "cannot upgrade dout thread priority\n");
 		goto err_stop_dout_thread;
@@ -384,7 +400,8 @@ int revpi_flat_probe(struct platform_device *pdev)
 		goto err_stop_dout_thread;
 	}
 
-	ret = set_rt_priority(flat->ain_thread, REVPI_FLAT_AIN_THREAD_PRIO);
+	ret = revpi_thread_register(REVPI_THREAD_AIN, flat->ain_thread,
+				    REVPI_FLAT_AIN_THREAD_PRIO);
 	if (ret) {
 		dev_err(piDev_g.dev, "cannot upgrade ain thread priority\n");
 		goto err_stop_ain_thread;
@@ -398,8 +415,10 @@ int revpi_flat_probe(struct platform_device *pdev)
 	return 0;
 
 err_stop_ain_thread:
+	revpi_thread_unregister(REVPI_THREAD_AIN);
 	kthread_stop(flat->ain_thread);
 err_stop_dout_thread:
+	revpi_thread_unregister(REVPI_THREAD_IO);
 	kthread_stop(flat->dout_thread);
 err_put_aout:
 	iio_device_put(flat->aout.indio_dev);
@@ -413,6 +432,8 @@ void revpi_flat_remove(struct platform_device *pdev)
 {
 	struct revpi_flat *flat = (struct revpi_flat *) piDev_g.machine;
 
+	revpi_thread_unregister(REVPI_THREAD_AIN);
+	revpi_thread_unregister(REVPI_THREAD_IO);
 	kthread_stop(flat->ain_thread);
 	kthread_stop(flat->dout_thread);
 	iio_device_put(flat->aout.indio_dev);
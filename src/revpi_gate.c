@@ -7,6 +7,7 @@
 #include <linux/netfilter.h>
 
 #include "ModGateComError.h"
+#include "revpi_common.h"
 #include "revpi_core.h"
 #include "revpi_gate.h"
 
@@ -123,7 +124,9 @@ static void revpi_gate_destroy_work(struct work_struct *work)
 	    !test_bit(PICONTROL_DEV_FLAG_STOP_IO, &piDev_g.flags)) {
 		conn->revpi_dev->i8uModuleState = FBSTATE_LINK;
 		rt_mutex_lock(&piDev_g.lockPI);
+		picontrol_image_write_begin();
 		memset(conn->in, 0, conn->in_len);
+		picontrol_image_write_end();
 		rt_mutex_unlock(&piDev_g.lockPI);
 	}
 
@@ -312,8 +315,10 @@ static int revpi_gate_process_cyclicpd(struct sk_buff *rcv,
 	    !test_bit(PICONTROL_DEV_FLAG_STOP_IO, &piDev_g.flags)) {
 		conn->revpi_dev->i8uModuleState = rcv_al->i8uFieldbusStatus;
 		rt_mutex_lock(&piDev_g.lockPI);
+		picontrol_image_write_begin();
 		memcpy(conn->in + rcv_al->i16uOffset, rcv_al->i8uData,
 		       rcv_al->i16uDataLen);
+		picontrol_image_write_end();
 		if (skb)
 			memcpy(al->i8uData, conn->out, conn->out_len);
 		rt_mutex_unlock(&piDev_g.lockPI);
@@ -640,7 +645,10 @@ void revpi_gate_init(void)
 	}
 	revpi_gate_rcv_thread = th;
 
-	sched_set_fifo(revpi_gate_rcv_thread);
+	/* MAX_RT_PRIO / 2 is the priority used by sched_set_fifo() */
+	if (revpi_thread_register(REVPI_THREAD_GATE, revpi_gate_rcv_thread,
+				  MAX_RT_PRIO / 2))
+		pr_warn("piControl: cannot set priority of revpi_gate_rcv_thread\n");
 
 	dev_add_pack(&revpi_gate_packet_type);
 }
@@ -653,6 +661,7 @@ void revpi_gate_fini(void)
 
 	dev_remove_pack(&revpi_gate_packet_type);
 
+	revpi_thread_unregister(REVPI_THREAD_GATE);
 	if (revpi_gate_rcv_thread)
 		kthread_stop(revpi_gate_rcv_thread);
 	while (!skb_queue_empty(&revpi_gate_rcvq)) {
@@ -32,9 +32,8 @@ static int revpi_mio_cycle_dio(SDevice *dev, SMioDigitalRequestData *req_data,
 		memset(&req, 0, sizeof(req));
 	}
 
-	ret = pibridge_req_io(piCore_g.pibridge, dev->i8uAddress,
-			      IOP_TYP1_CMD_DATA, &req, sizeof(req), &resp,
-			      sizeof(resp));
+	ret = RevPiDevice_req_io(dev, IOP_TYP1_CMD_DATA, &req, sizeof(req),
+				 &resp, sizeof(resp));
 	if (ret != sizeof(resp)) {
 		pr_debug("MIO addr %2d: dio communication failed (req:%zu,ret:%d)\n",
 			dev->i8uAddress, sizeof(resp), ret);
@@ -48,7 +47,9 @@ static int revpi_mio_cycle_dio(SDevice *dev, SMioDigitalRequestData *req_data,
 	/*copy: from response to process image:input*/
 	if (!test_bit(PICONTROL_DEV_FLAG_STOP_IO, &piDev_g.flags)) {
 		rt_mutex_lock(&piDev_g.lockPI);
+		picontrol_image_write_begin();
 		memcpy(resp_data, &resp, sizeof(*resp_data));
+		picontrol_image_write_end();
 		rt_mutex_unlock(&piDev_g.lockPI);
 	}
 
@@ -62,10 +63,9 @@ static int revpi_mio_cycle_aio(SDevice *dev, SMioAnalogRequestData *req_data,
 	SMioAnalogResponseData resp;
 	int ret;
 
-	ret = pibridge_req_io(piCore_g.pibridge, dev->i8uAddress,
-			      IOP_TYP1_CMD_DATA2, req_data,
-			      sizeof(*req_data) - compressed, &resp,
-			      sizeof(resp));
+	ret = RevPiDevice_req_io(dev, IOP_TYP1_CMD_DATA2, req_data,
+				 sizeof(*req_data) - compressed, &resp,
+				 sizeof(resp));
 	if (ret != sizeof(resp)) {
 		pr_debug("MIO addr %2d: aio communication failed (req:%zd,ret:%d)\n",
 			dev->i8uAddress, sizeof(resp), ret);
@@ -79,63 +79,15 @@ static int revpi_mio_cycle_aio(SDevice *dev, SMioAnalogRequestData *req_data,
 	/*copy: from response to process image*/
 	if (!test_bit(PICONTROL_DEV_FLAG_STOP_IO, &piDev_g.flags)) {
 		rt_mutex_lock(&piDev_g.lockPI);
+		picontrol_image_write_begin();
 		memcpy(resp_data, &resp, sizeof(*resp_data));
+		picontrol_image_write_end();
 		rt_mutex_unlock(&piDev_g.lockPI);
 	}
 
 	return 0;
 }
 
-/*
-	compare to get the changed values of channels
-	input parameters:
-		a, b: data of two messages
-		count: count of channels
-		step: number of bytes for a channel
-	return:	bit map of changed channels
-*/
-static unsigned long revpi_chnl_cmp(void *a, void *b, int count, int step)
-{
-	unsigned char *pa, *pb;
-	unsigned long ret = 0;
-	int i;
-
-	pa = (unsigned char *) a;
-	pb = (unsigned char *) b;
-
-	for (i = 0; i < count; i++) {
-		if (memcmp(pa + i * step, pb + i * step, step))
-			__set_bit(i, &ret);
-	}
-	return ret;
-}
-
-/*
-	compress the channel, only data of changed channel will be taken
-	input parameters:
-		dst, dst: compress from src to dst
-		bitmap: compress according to
-		step: number of bytes for a channel
-	return: the count of channels has been taken.
-*/
-static unsigned int revpi_chnl_compress(void *dst, void *src,
-					unsigned long bitmap, int step)
-{
-	unsigned char *d, *s;
-	unsigned int i, last = __fls(bitmap);
-
-	s = (unsigned char *) src;
-	d = (unsigned char *) dst;
-
-	for (i = 0; i <= last; i++) {
-		if (test_bit(i, &bitmap)) {
-			memcpy(d, s + i * step, step);
-			d += step;
-		}
-	}
-	return (d - (unsigned char *)dst) / step;
-}
-
 int revpi_mio_cycle(unsigned char devno)
 {
 	SMioAnalogRequestData pending_values;
@@ -163,7 +115,7 @@ int revpi_mio_cycle(unsigned char devno)
 		my_rt_mutex_lock(&piDev_g.lockPI);
 		io_req_ex.i8uLogicLevel = img_out->aio.i8uLogicLevel;
 
-		io_req_ex.i8uChannels = revpi_chnl_cmp(&last->i16uOutputVoltage,
+		io_req_ex.i8uChannels = revpi_delta_changed(&last->i16uOutputVoltage,
 						&img_out->aio.i16uOutputVoltage,
 						MIO_AIO_PORT_CNT, 2);
 		/* force to update from process image */
@@ -174,7 +126,7 @@ int revpi_mio_cycle(unsigned char devno)
 			memcpy(&pending_values.i16uOutputVoltage,
 				&img_out->aio.i16uOutputVoltage,
 				sizeof(unsigned short) * MIO_AIO_PORT_CNT);
-			ch_cnt = revpi_chnl_compress(&io_req_ex.i16uOutputVoltage,
+			ch_cnt = revpi_delta_pack(&io_req_ex.i16uOutputVoltage,
 						&pending_values.i16uOutputVoltage,
 						io_req_ex.i8uChannels, 2);
 		}
@@ -317,6 +269,9 @@ int revpi_mio_init(unsigned char devno)
 		if (mio_list[i].addr == addr) {
 			conf = &mio_list[i];
 			RevPiDevice_getDev(devno)->i8uPriv = (unsigned char) i;
+			/* send all outputs again, see RevPiDevice_recover() */
+			memset(&mio_aio_request_last[i], 0,
+			       sizeof(mio_aio_request_last[i]));
 			break;
 		}
 	}
@@ -326,27 +281,36 @@ int revpi_mio_init(unsigned char devno)
 		return -ENODATA;
 	}
 
+	/*
+	 * stop at the first error, the module does not respond. The messages
+	 * are rate limited because RevPiDevice_recover() retries periodically.
+	 */
 	/*dio*/
 	ret = pibridge_req_io(piCore_g.pibridge, addr, IOP_TYP1_CMD_CFG,
 			      &conf->dio, sizeof(conf->dio), NULL, 0);
 	if (ret) {
-		pr_err("talk with mio for conf dio err(devno:%d, ret:%d)\n",
-		       devno, ret);
+		pr_err_ratelimited("talk with mio for conf dio err(devno:%d, ret:%d)\n",
+				   devno, ret);
+		return ret;
 	}
 
 	/*aio in*/
 	ret = pibridge_req_io(piCore_g.pibridge, addr, IOP_TYP1_CMD_DATA4,
 			      &conf->aio_i, sizeof(conf->aio_i), NULL, 0);
-	if (ret)
-		pr_err("talk with mio for conf aio_i err(devno:%d, ret:%d)\n",
-		       devno, ret);
+	if (ret) {
+		pr_err_ratelimited("talk with mio for conf aio_i err(devno:%d, ret:%d)\n",
+				   devno, ret);
+		return ret;
+	}
 
 	/*aio out*/
 	ret = pibridge_req_io(piCore_g.pibridge, addr, IOP_TYP1_CMD_DATA4,
 			      &conf->aio_o, sizeof(conf->aio_o), NULL, 0);
-	if (ret)
-		pr_err("talk with mio for conf aio_o err(devno:%d, ret:%d)\n",
-		       devno, ret);
+	if (ret) {
+		pr_err_ratelimited("talk with mio for conf aio_o err(devno:%d, ret:%d)\n",
+				   devno, ret);
+		return ret;
+	}
 
 	pr_debug("MIO Initializing finished(devno:%d, addr:%d)\n", devno, addr);
 
@@ -119,9 +119,10 @@ int revpi_ro_cycle(unsigned int devnum)
 		memset(&state_out, 0, sizeof(state_out));
 	}
 
-	ret = pibridge_req_io(piCore_g.pibridge, dev->i8uAddress,
-			      IOP_TYP1_CMD_DATA, &state_out, sizeof(state_out),
-			      &status_in, sizeof(status_in));
+	/* the single byte target state is also the request for the status */
+	ret = RevPiDevice_req_io(dev, IOP_TYP1_CMD_DATA, &state_out,
+				 sizeof(state_out), &status_in,
+				 sizeof(status_in));
 
 	if (ret != sizeof(status_in)) {
 		pr_debug("RO addr %2d: communication failed (req:%zu,ret:%d)\n",
@@ -135,7 +136,9 @@ int revpi_ro_cycle(unsigned int devnum)
 
 	if (!test_bit(PICONTROL_DEV_FLAG_STOP_IO, &piDev_g.flags)) {
 		rt_mutex_lock(&piDev_g.lockPI);
+		picontrol_image_write_begin();
 		img_in->status = status_in;
+		picontrol_image_write_end();
 		rt_mutex_unlock(&piDev_g.lockPI);
 	}
 
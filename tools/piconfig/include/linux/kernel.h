@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ * SPDX-FileCopyrightText: 2026 KUNBUS GmbH
+ */
+
+/*
+ * The parts of the kernel API which are used by json.c and piConfig.c,
+ * implemented on top of libc. The other headers in this directory only
+ * include this one.
+ */
+
+#ifndef PICONFIG_SHIM_KERNEL_H_
+#define PICONFIG_SHIM_KERNEL_H_
+
+#include_next <linux/types.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+typedef __u8 u8;
+typedef __u16 u16;
+typedef __u32 u32;
+typedef __u64 u64;
+typedef __s8 s8;
+typedef __s16 s16;
+typedef __s32 s32;
+typedef __s64 s64;
+
+#define U16_MAX		((u16) ~0U)
+#define U32_MAX		((u32) ~0U)
+
+#define PAGE_SIZE	4096UL
+#define ALIGN(x, a)	(((x) + ((a) - 1)) & ~((typeof(x)) (a) - 1))
+#define PAGE_ALIGN(x)	ALIGN(x, PAGE_SIZE)
+#define __aligned(x)	__attribute__((__aligned__(x)))
+
+#define min(a, b)	((a) < (b) ? (a) : (b))
+#define max(a, b)	((a) > (b) ? (a) : (b))
+#define max_t(t, a, b)	max((t) (a), (t) (b))
+#define DIV_ROUND_UP(n, d)	(((n) + (d) - 1) / (d))
+
+/* messages up to this level are printed: 0 none, 1 errors, 2 info */
+extern int piconfig_loglevel;
+
+#define piconfig_log(level, ...) \
+	((level) <= piconfig_loglevel ? fprintf(stderr, __VA_ARGS__) : 0)
+#define pr_err(...)	piconfig_log(1, __VA_ARGS__)
+#define pr_warn(...)	piconfig_log(1, __VA_ARGS__)
+#define pr_info(...)	piconfig_log(2, __VA_ARGS__)
+#define pr_debug(...)	do { } while (0)
+
+/* allocations */
+#define GFP_KERNEL	0
+
+struct piconfig_alloc_stats {
+	u64 count;		// number of allocations
+	u64 bytes;		// sum of all allocated sizes
+};
+extern struct piconfig_alloc_stats piconfig_alloc_stats;
+
+void *kmalloc(size_t size, int flags);
+void *kzalloc(size_t size, int flags);
+void *kcalloc(size_t n, size_t size, int flags);
+void *krealloc(const void *p, size_t size, int flags);
+void *kmemdup(const void *p, size_t size, int flags);
+void kfree(const void *p);
+#define kvmalloc	kmalloc
+#define kvzalloc	kzalloc
+#define kvfree		kfree
+
+/* files */
+struct file {
+	int fd;
+	long long f_pos;
+};
+
+#define IS_ERR(p)	((p) == NULL)
+
+struct file *filp_open(const char *filename, int flags, int mode);
+int filp_close(struct file *file, void *id);
+ssize_t kernel_read(struct file *file, void *buf, size_t count, long long *pos);
+
+/* misc */
+int kstrtou8(const char *s, unsigned int base, u8 *res);
+int kstrtou16(const char *s, unsigned int base, u16 *res);
+int kstrtou32(const char *s, unsigned int base, u32 *res);
+int kstrtos32(const char *s, unsigned int base, s32 *res);
+
+void sort(void *base, size_t num, size_t size,
+	  int (*cmp)(const void *, const void *),
+	  void (*swap)(void *, void *, int));
+
+void *memchr_inv(const void *p, int c, size_t size);
+
+#define struct_size(p, member, n) \
+	(sizeof(*(p)) + (n) * sizeof(*(p)->member))
+
+u32 crc32_le(u32 crc, const void *p, size_t len);
+
+static inline unsigned long roundup_pow_of_two(unsigned long n)
+{
+	unsigned long r = 1;
+
+	while (r < n)
+		r <<= 1;
+	return r;
+}
+
+struct dentry;
+static inline void debugfs_create_u64(const char *name, int mode,
+				      struct dentry *parent, u64 *value)
+{
+}
+
+#define module_param(name, type, perm)
+#define MODULE_PARM_DESC(name, desc)
+
+typedef int seqlock_t;
+struct platform_device;
+
+#endif /* PICONFIG_SHIM_KERNEL_H_ */
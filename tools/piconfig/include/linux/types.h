@@ -0,0 +1,5 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ * SPDX-FileCopyrightText: 2026 KUNBUS GmbH
+ */
+
+#include <linux/kernel.h>
@@ -0,0 +1,203 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// SPDX-FileCopyrightText: 2026 KUNBUS GmbH
+
+/* Userspace implementation of the kernel API in include/linux/kernel.h */
+
+#include <unistd.h>
+
+#include <linux/kernel.h>
+
+int piconfig_loglevel = 1;
+struct piconfig_alloc_stats piconfig_alloc_stats;
+
+static void count_alloc(size_t size)
+{
+	piconfig_alloc_stats.count++;
+	piconfig_alloc_stats.bytes += size;
+}
+
+void *kmalloc(size_t size, int flags)
+{
+	count_alloc(size);
+	return malloc(size ? size : 1);
+}
+
+void *kzalloc(size_t size, int flags)
+{
+	count_alloc(size);
+	return calloc(1, size ? size : 1);
+}
+
+void *kcalloc(size_t n, size_t size, int flags)
+{
+	count_alloc(n * size);
+	return calloc(n ? n : 1, size ? size : 1);
+}
+
+void *krealloc(const void *p, size_t size, int flags)
+{
+	count_alloc(size);
+	return realloc((void *) p, size ? size : 1);
+}
+
+void *kmemdup(const void *p, size_t size, int flags)
+{
+	void *q = kmalloc(size, flags);
+
+	if (q)
+		memcpy(q, p, size);
+	return q;
+}
+
+void kfree(const void *p)
+{
+	free((void *) p);
+}
+
+struct file *filp_open(const char *filename, int flags, int mode)
+{
+	struct file *file;
+	int fd;
+
+	fd = open(filename, flags, mode);
+	if (fd < 0)
+		return NULL;
+
+	file = malloc(sizeof(*file));
+	if (!file) {
+		close(fd);
+		return NULL;
+	}
+	file->fd = fd;
+	file->f_pos = 0;
+	return file;
+}
+
+int filp_close(struct file *file, void *id)
+{
+	close(file->fd);
+	free(file);
+	return 0;
+}
+
+ssize_t kernel_read(struct file *file, void *buf, size_t count, long long *pos)
+{
+	ssize_t ret;
+
+	ret = pread(file->fd, buf, count, *pos);
+	if (ret < 0)
+		return -errno;
+	*pos += ret;
+	return ret;
+}
+
+static int kstrtoull(const char *s, unsigned int base, unsigned long long max,
+		     unsigned long long *res)
+{
+	unsigned long long v;
+	char *end;
+
+	if (*s == '+')
+		s++;
+	if (*s == '-' || *s == 0)
+		return -EINVAL;
+
+	errno = 0;
+	v = strtoull(s, &end, base);
+	if (errno == ERANGE || v > max)
+		return -ERANGE;
+	if (*end == '\n')
+		end++;
+	if (end == s || *end)
+		return -EINVAL;
+
+	*res = v;
+	return 0;
+}
+
+int kstrtou8(const char *s, unsigned int base, u8 *res)
+{
+	unsigned long long v;
+	int ret = kstrtoull(s, base, UINT8_MAX, &v);
+
+	if (!ret)
+		*res = v;
+	return ret;
+}
+
+int kstrtou16(const char *s, unsigned int base, u16 *res)
+{
+	unsigned long long v;
+	int ret = kstrtoull(s, base, UINT16_MAX, &v);
+
+	if (!ret)
+		*res = v;
+	return ret;
+}
+
+int kstrtou32(const char *s, unsigned int base, u32 *res)
+{
+	unsigned long long v;
+	int ret = kstrtoull(s, base, UINT32_MAX, &v);
+
+	if (!ret)
+		*res = v;
+	return ret;
+}
+
+int kstrtos32(const char *s, unsigned int base, s32 *res)
+{
+	unsigned long long v;
+	int ret;
+
+	if (*s == '-') {
+		ret = kstrtoull(s + 1, base, (unsigned long long) INT32_MAX + 1, &v);
+		if (!ret)
+			*res = -(long long) v;
+	} else {
+		ret = kstrtoull(s, base, INT32_MAX, &v);
+		if (!ret)
+			*res = v;
+	}
+	return ret;
+}
+
+void sort(void *base, size_t num, size_t size,
+	  int (*cmp)(const void *, const void *),
+	  void (*swap)(void *, void *, int))
+{
+	qsort(base, num, size, cmp);
+}
+
+void *memchr_inv(const void *p, int c, size_t size)
+{
+	const u8 *data = p;
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		if (data[i] != (u8) c)
+			return (void *) &data[i];
+	return NULL;
+}
+
+u32 crc32_le(u32 crc, const void *p, size_t len)
+{
+	static u32 table[256];
+	const u8 *data = p;
+	size_t i;
+	int j;
+
+	if (!table[1]) {
+		for (i = 0; i < 256; i++) {
+			u32 c = i;
+
+			for (j = 0; j < 8; j++)
+				c = (c & 1) ? (c >> 1) ^ 0xedb88320 : c >> 1;
+			table[i] = c;
+		}
+	}
+
+	for (i = 0; i < len; i++)
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return crc;
+}
@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// SPDX-FileCopyrightText: 2026 KUNBUS GmbH
+
+/*
+ * The module drivers are not part of the userspace build. piConfigParse()
+ * only calls them if it is asked to configure the modules, which the tools
+ * never do.
+ */
+
+#include "piAIOComm.h"
+#include "piDIOComm.h"
+#include "revpi_compact.h"
+#include "revpi_mio.h"
+#include "revpi_ro.h"
+
+void piDIOComm_InitStart(void)
+{
+}
+
+u32 piDIOComm_Config(uint8_t i8uAddress, uint16_t i16uNumEntries, SEntryInfo * pEnt)
+{
+	return 0;
+}
+
+void piAIOComm_InitStart(void)
+{
+}
+
+u32 piAIOComm_Config(u8 addr, u16 num_entries, SEntryInfo * pEnt)
+{
+	return 0;
+}
+
+u32 revpi_compact_config(uint8_t i8uAddress, uint16_t i16uNumEntries, SEntryInfo * pEnt)
+{
+	return 0;
+}
+
+void revpi_mio_reset(void)
+{
+}
+
+int revpi_mio_config(unsigned char addr, unsigned short ent_cnt, SEntryInfo *ent)
+{
+	return 0;
+}
+
+void revpi_ro_reset(void)
+{
+}
+
+int revpi_ro_config(u8 addr, int num_entries, SEntryInfo *pEnt)
+{
+	return 0;
+}
@@ -0,0 +1,183 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// SPDX-FileCopyrightText: 2026 KUNBUS GmbH
+
+/*
+ * Measure the time and the allocations of piConfigParse() for generated
+ * configurations of increasing size:
+ *
+ *	piconfig-bench [-d devices] [-e entries] [-c connections] [-s steps] [-n runs]
+ *
+ * Every device gets the given number of inputs and outputs of one bit. The
+ * number of devices, entries and connections is doubled in each step, up to
+ * the given maximum. The time is the best of all runs.
+ */
+
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "piConfig.h"
+#include "project.h"
+
+static void write_entries(FILE *f, unsigned int dev, const char *type,
+			  unsigned int entries, unsigned int first_offset)
+{
+	unsigned int i;
+
+	fprintf(f, "\"%s\":{", type);
+	for (i = 0; i < entries; i++)
+		fprintf(f, "%s\"%u\":[\"%s_%u_%u\",\"0\",\"1\",\"%u\",%s,\"%04u\",\"\",\"%u\"]",
+			i ? "," : "", i, type, dev, i, first_offset + i / 8,
+			i % 2 ? "true" : "false", i, i % 8);
+	fprintf(f, "}");
+}
+
+/* Write a configuration in the format of PiCtory, return its file name. */
+static char *generate_config(unsigned int devices, unsigned int entries,
+			     unsigned int connections)
+{
+	static char filename[] = "/tmp/piconfig-bench-XXXXXX";
+	unsigned int d, i, offset = 0, bytes = DIV_ROUND_UP(entries, 8);
+	int fd;
+	FILE *f;
+
+	strcpy(filename + strlen(filename) - 6, "XXXXXX");
+	fd = mkstemp(filename);
+	if (fd < 0 || !(f = fdopen(fd, "w"))) {
+		perror(filename);
+		exit(1);
+	}
+
+	fprintf(f, "{\"App\":{\"name\":\"piconfig-bench\"},\"Devices\":[");
+	for (d = 0; d < devices; d++) {
+		fprintf(f, "%s{\"GUID\":\"%u\",\"productType\":\"96\",\"position\":\"%u\","
+			"\"name\":\"dev%u\",\"offset\":%u,",
+			d ? "," : "", d, REV_PI_DEV_FIRST_RIGHT + d, d, offset);
+		write_entries(f, d, "inp", entries, 0);
+		fprintf(f, ",");
+		write_entries(f, d, "out", entries, bytes);
+		fprintf(f, ",\"mem\":{},\"config\":{}}");
+		offset += 2 * bytes;
+	}
+
+	// connect the inputs of one device to the outputs of the next one
+	fprintf(f, "],\"Connections\":[");
+	for (i = 0; i < connections; i++) {
+		d = (i / entries) % devices;
+		fprintf(f, "%s{\"srcGUID\":\"%u\",\"srcAttrname\":\"inp_%u_%u\","
+			"\"destGUID\":\"%u\",\"destAttrname\":\"out_%u_%u\"}",
+			i ? "," : "", d, d, i % entries,
+			(d + 1) % devices, (d + 1) % devices, i % entries);
+	}
+	fprintf(f, "]}\n");
+
+	if (fclose(f)) {
+		perror(filename);
+		exit(1);
+	}
+	return filename;
+}
+
+struct bench_result {
+	double ms;
+	u64 allocs;		// number of allocations
+	u64 alloc_bytes;	// allocated bytes in total
+};
+
+static void parse(const char *filename, struct bench_result *res)
+{
+	struct piconfig_alloc_stats before = piconfig_alloc_stats;
+	piConnectionList *connl;
+	struct timespec t0, t1;
+	piCopylist *cl;
+	piEntries *ent;
+	piDevices *devs;
+	int ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	ret = piConfigParse(filename, &devs, &ent, &cl, &connl, false);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	if (ret) {
+		fprintf(stderr, "%s: parsing failed (%d)\n", filename, ret);
+		exit(1);
+	}
+
+	kfree(connl);
+	kfree(cl);
+	kfree(ent);
+	kfree(devs);
+
+	res->ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+	res->allocs = piconfig_alloc_stats.count - before.count;
+	res->alloc_bytes = piconfig_alloc_stats.bytes - before.bytes;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int devices = 64, entries = 256, connections = 16384;
+	unsigned int steps = 6, runs = 5;
+	unsigned int step, i, d, e, c;
+	struct bench_result res, best;
+	char *filename;
+	struct stat st;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "d:e:c:s:n:")) != -1) {
+		switch (opt) {
+		case 'd':
+			devices = atoi(optarg);
+			break;
+		case 'e':
+			entries = atoi(optarg);
+			break;
+		case 'c':
+			connections = atoi(optarg);
+			break;
+		case 's':
+			steps = atoi(optarg);
+			break;
+		case 'n':
+			runs = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: piconfig-bench [-d devices] [-e entries] "
+				"[-c connections] [-s steps] [-n runs]\n");
+			return 2;
+		}
+	}
+	if (devices < 1 || devices > 200 || entries < 1 || steps < 1 || runs < 1
+	    || 2 * devices * entries >= U16_MAX
+	    || 2 * devices * DIV_ROUND_UP(entries, 8) > KB_PI_LEN) {
+		fprintf(stderr, "1-200 devices, less than %u entries and %u bytes "
+			"in total\n", U16_MAX, KB_PI_LEN);
+		return 2;
+	}
+
+	printf("%8s %8s %8s %10s %10s %8s %10s\n", "devices", "entries", "conns",
+	       "bytes", "ms", "allocs", "alloc KiB");
+	for (step = steps; step-- > 0;) {
+		d = max(devices >> step, 1U);
+		e = max(entries >> step, 1U);
+		c = connections >> step;
+
+		filename = generate_config(d, e, c);
+		if (stat(filename, &st)) {
+			perror(filename);
+			return 1;
+		}
+
+		for (i = 0; i < runs; i++) {
+			parse(filename, &res);
+			if (i == 0 || res.ms < best.ms)
+				best = res;
+		}
+		printf("%8u %8u %8u %10lld %10.2f %8llu %10llu\n", d, 2 * d * e, c,
+		       (long long) st.st_size, best.ms,
+		       (unsigned long long) best.allocs,
+		       (unsigned long long) best.alloc_bytes / 1024);
+
+		unlink(filename);
+	}
+
+	return 0;
+}
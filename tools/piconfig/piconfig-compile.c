@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// SPDX-FileCopyrightText: 2026 KUNBUS GmbH
+
+/*
+ * Compile config.rsc into the image which piControl loads instead of
+ * parsing the JSON file, as long as config.rsc is not changed:
+ *
+ *	piconfig-compile [-v] [config.rsc [config.rsc.bin]]
+ */
+
+#include <unistd.h>
+
+#include "piConfig.h"
+
+static int write_image(const char *filename, const void *image, size_t size)
+{
+	char tmp[PATH_MAX];
+	FILE *f;
+
+	// replace the image atomically, piControl may read it at any time
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", filename) >= (int) sizeof(tmp))
+		return -ENAMETOOLONG;
+
+	f = fopen(tmp, "wb");
+	if (!f)
+		return -errno;
+	if (fwrite(image, size, 1, f) != 1 || fflush(f) || fsync(fileno(f))) {
+		fclose(f);
+		unlink(tmp);
+		return -EIO;
+	}
+	if (fclose(f) || rename(tmp, filename)) {
+		unlink(tmp);
+		return -errno;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *src = PICONFIG_FILE, *dst = PICONFIG_IMAGE_FILE;
+	void *image;
+	size_t size;
+	int ret;
+
+	if (argc > 1 && strcmp(argv[1], "-v") == 0) {
+		piconfig_loglevel = 2;
+		argc--;
+		argv++;
+	}
+	if (argc > 3 || (argc > 1 && argv[1][0] == '-')) {
+		fprintf(stderr, "usage: piconfig-compile [-v] [config.rsc [config.rsc.bin]]\n");
+		return 2;
+	}
+	if (argc > 1)
+		src = argv[1];
+	if (argc > 2)
+		dst = argv[2];
+
+	ret = piConfigCompile(src, &image, &size);
+	if (ret) {
+		fprintf(stderr, "%s: cannot be compiled (%d)\n", src, ret);
+		return 1;
+	}
+
+	ret = write_image(dst, image, size);
+	kfree(image);
+	if (ret) {
+		fprintf(stderr, "%s: %s\n", dst, strerror(-ret));
+		return 1;
+	}
+
+	if (piconfig_loglevel > 1)
+		fprintf(stderr, "%s: %zu bytes written\n", dst, size);
+	return 0;
+}
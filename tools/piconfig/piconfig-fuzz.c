@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: GPL-2.0-only
+// SPDX-FileCopyrightText: 2026 KUNBUS GmbH
+
+/*
+ * libFuzzer entry point for the configuration parser:
+ *
+ *	make fuzz
+ *	./piconfig-fuzz corpus/
+ *
+ * The input is fed to json_parser_string() in two pieces, so that tokens
+ * split between two reads are covered as well. Then the whole input is
+ * loaded with piConfigParse() as a configuration file.
+ *
+ * piconfig-fuzz-replay is built without libFuzzer and runs the entry point
+ * once for each file given on the command line, e.g. to check a crash on a
+ * system without clang.
+ */
+
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "piConfig.h"
+
+static int fuzz_callback(void *userdata, int type, const char *data, uint32_t length)
+{
+	volatile char sum = 0;
+	uint32_t i;
+
+	// let the sanitizer check the value passed by the parser
+	for (i = 0; i < length; i++)
+		sum += data[i];
+	return 0;
+}
+
+static void fuzz_json(const uint8_t *data, size_t size)
+{
+	json_config config;
+	json_parser parser;
+	size_t split;
+	int ret;
+
+	memset(&config, 0, sizeof(config));
+	config.allow_c_comments = 1;
+	config.allow_yaml_comments = 1;
+
+	if (json_parser_init(&parser, &config, fuzz_callback, NULL))
+		return;
+
+	split = size ? data[0] % size : 0;
+	ret = json_parser_string(&parser, (const char *) data, split, NULL);
+	if (!ret)
+		ret = json_parser_string(&parser, (const char *) data + split,
+					 size - split, NULL);
+	if (!ret)
+		json_parser_is_done(&parser);
+
+	json_parser_free(&parser);
+}
+
+static void fuzz_config(const uint8_t *data, size_t size)
+{
+	piConnectionList *connl;
+	char filename[64];
+	piCopylist *cl;
+	piEntries *ent;
+	piDevices *devs;
+	int fd;
+
+	fd = memfd_create("config.rsc", 0);
+	if (fd < 0)
+		return;
+	if (write(fd, data, size) == (ssize_t) size) {
+		snprintf(filename, sizeof(filename), "/proc/self/fd/%d", fd);
+		if (piConfigParse(filename, &devs, &ent, &cl, &connl, false) == 0) {
+			kfree(connl);
+			kfree(cl);
+			kfree(ent);
+			kfree(devs);
+		}
+	}
+	close(fd);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	piconfig_loglevel = 0;
+
+	fuzz_json(data, size);
+	fuzz_config(data, size);
+	return 0;
+}
+
+#ifdef PICONFIG_FUZZ_REPLAY
+int main(int argc, char *argv[])
+{
+	uint8_t *data;
+	size_t size;
+	FILE *f;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		f = fopen(argv[i], "rb");
+		if (!f) {
+			perror(argv[i]);
+			return 1;
+		}
+		fseek(f, 0, SEEK_END);
+		size = ftell(f);
+		rewind(f);
+		data = malloc(size ? size : 1);
+		if (!data || fread(data, 1, size, f) != size) {
+			perror(argv[i]);
+			return 1;
+		}
+		fclose(f);
+
+		LLVMFuzzerTestOneInput(data, size);
+		free(data);
+		printf("%s: ok\n", argv[i]);
+	}
+	return 0;
+}
+#endif